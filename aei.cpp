@@ -371,6 +371,11 @@ void Aei::handleOption(const string& commandRest)
       return;
     }
 
+  //configuration items might be set as well
+  if (cfg.setItem(option, value)){
+    return;
+  }
+
   aeiLog(STR_UNKNOWN_OPTION + option, AL_WARNING);
 }
 
@@ -463,6 +468,8 @@ void Aei::searchInThread()
 void * Aei::SearchInThreadWrapper(void* instance)
 {
   ((Aei*) instance)->searchInThread();
+  //search thread is created for every search
+  glob.releaseThread();
   return NULL;
 }
 
@@ -192,6 +192,43 @@ void Benchmark::benchmarkSearch() const
 
 //--------------------------------------------------------------------- 
 
+void Benchmark::benchmarkScaling() const
+{
+  int threadsMax = cfg.searchThreadsNum();
+  bool sharedTree = cfg.sharedTree();
+  bool earlyStop = cfg.earlyStop();
+  cfg.setItem("shared_tree", "1");
+  //every thread count gets the whole second
+  cfg.setItem("early_stop", "0");
+
+  logRaw("Shared tree scaling: \n");
+  for (int threads = 1; threads <= threadsMax; threads++){
+    stringstream ss;
+    ss << threads;
+    cfg.setItem("search_threads_num", ss.str());
+
+    Engine* engine = new Engine();
+    engine->timeManager()->setTimeControl(TC_MOVE, SEC_ONE + CLOCK_CLICK_RESERVE);
+    engine->doSearch(board_);
+    double seconds = engine->timeManager()->secondsElapsed();
+    logRaw("  %d threads: %d pps\n", threads, 
+           int(engine->getPlayoutsNum() / seconds));
+    vector<int> threadPlayouts = engine->getThreadPlayouts();
+    for (uint i = 0; i < threadPlayouts.size(); i++){
+      logRaw("    thread %d: %d pps\n", i, int(threadPlayouts[i] / seconds));
+    }
+    delete engine;
+  }
+
+  stringstream ss;
+  ss << threadsMax;
+  cfg.setItem("search_threads_num", ss.str());
+  cfg.setItem("shared_tree", sharedTree ? "1" : "0");
+  cfg.setItem("early_stop", earlyStop ? "1" : "0");
+}
+
+//--------------------------------------------------------------------- 
+
 void Benchmark::benchmarkAll() 
 {
   benchmarkCopyBoard();
@@ -200,6 +237,7 @@ void Benchmark::benchmarkAll()
   benchmarkPlayout();
   benchmarkUct();
   benchmarkSearch();
+  benchmarkScaling();
   
 }
 
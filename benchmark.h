@@ -9,6 +9,7 @@
  * \li old board playout speed
  * \li uct traversing 
  * \li complete uct search
+ * \li parallel (shared tree) search scaling
  */
 
 #pragma once
@@ -50,6 +51,7 @@ class Benchmark
 		void benchmarkOldPlayout(); 
 		void benchmarkUct(); 
 		void benchmarkSearch() const;
+		void benchmarkScaling() const;
     
     void benchmarkAll();
 
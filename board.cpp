@@ -10,8 +10,6 @@ Eval*  Board::eval_;
 
 Glob glob;
 
-int threadsNum = 0;
-int threadIds[MAX_THREADS];
 
 //#define DEBUG_TRAPCHECK_ON
 
@@ -30,75 +28,59 @@ bool Board::classInit = false;
 
 //--------------------------------------------------------------------- 
 
-Glob::Glob() 
+SearchContext::SearchContext(unsigned int seed): grand(seed)
 {
-  for (int i = 0; i < MAX_THREADS; i++){
-    bpool_[i] = NULL;
-    thirdRep_[i] = NULL;
-  }
-  init();
+  ;
 }
 
 //--------------------------------------------------------------------- 
 
-void Glob::init()
+SearchContext::~SearchContext()
 {
-  assert(threadsNum < MAX_THREADS);
-  for (int i = 0; i < MAX_THREADS; i++){
-    if (bpool_[i] != NULL){
-      delete bpool_[i];
-      bpool_[i] = NULL;
-    }
-    if (thirdRep_[i] != NULL){
-      delete thirdRep_[i];
-      thirdRep_[i] = NULL;
-    }
-    if (grand_[i] != NULL){
-      delete grand_[i];
-      grand_[i] = NULL;
-    }
+  while (! bpool.empty()){
+    free(bpool.top());
+    bpool.pop();
   }
-  threadsNum_ = 0;
-
 }
 
 //--------------------------------------------------------------------- 
 
-int Glob::tti() 
-{
-  int index = pthread_self();
-  for (int i = 0; i < threadsNum_; i++){
-    if (threadIds_[i] == index){
-      return i;
-    }  
-  }
+__thread SearchContext* Glob::context_ = NULL;
 
-  return add_thread();
+//--------------------------------------------------------------------- 
+
+Glob::Glob() 
+{
+  pthread_mutex_init(&lock, NULL);
 }
 
 //--------------------------------------------------------------------- 
 
-int Glob::add_thread() {
+SearchContext* Glob::add_thread() {
 
   pthread_mutex_lock(&lock);
-  threadIds_[threadsNum_] = pthread_self();
-  bpool_[threadsNum_] = new Bpool();
-  thirdRep_[threadsNum_] = new ThirdRep();
-  grand_[threadsNum_] = new Grand(rand());
-  int ret = threadsNum_;
-  threadsNum_++;
+  context_ = new SearchContext(rand());
   pthread_mutex_unlock(&lock);
-  return ret;
+  return context_;
+}
+
+//--------------------------------------------------------------------- 
+
+void Glob::releaseThread() {
+
+  delete context_;
+  context_ = NULL;
 }
 
 //--------------------------------------------------------------------- 
 
 void globalStructuresInit()
 {
+  //keys are the same in every run (search might be reproduced)
+  srand(ZOBRIST_SEED);
+  bits::initZobrist();
   uint seed = (unsigned) time(NULL);
-  //uint seed = 1244026459;
   srand(seed);
-  bits::initZobrist();
   initCachedFunctions();
 }
 
@@ -318,6 +300,24 @@ bool Step::inversed(const Step& s) const
 
 //---------------------------------------------------------------------
 
+bool Step::commutes(const Step& s) const 
+{
+  if (! pieceMoved() || ! s.pieceMoved()){
+    return false;
+  }
+  u64 mine = BIT_ON(from_) | BIT_ON(to_);
+  if (isPushPull()){
+    mine |= BIT_ON(oppFrom_) | BIT_ON(oppTo_);
+  }
+  u64 other = BIT_ON(s.from_) | BIT_ON(s.to_);
+  if (s.isPushPull()){
+    other |= BIT_ON(s.oppFrom_) | BIT_ON(s.oppTo_);
+  }
+  return ! ((mine | bits::neighbors(mine)) & (other | bits::neighbors(other)));
+}
+
+//---------------------------------------------------------------------
+
 /* returns true if any piece was moved
  * i.e. returns false if pass or no_step */
 bool Step::pieceMoved() const 
@@ -769,8 +769,10 @@ ContextMove::ContextMove(Move move, const Bitboard& bitboard):
     }
   }
 
-  visits_ = 0;
-  value_ = 0;
+  Stats stats;
+  stats.value = 0;
+  stats.visits = 0;
+  packed_ = pack(stats);
 
   /*cerr << "=== Context Move ===" << endl 
     << Board::bitboardToString(bitboard) 
@@ -785,8 +787,8 @@ ContextMove::ContextMove(Move move, const Bitboard& bitboard):
 
 float ContextMove::urgency(player_t player, int total) const
 {
-  //cerr << value_ << " " << total << " " << visits_ << endl;
-  return value_ * (player == GOLD ? 1 : -1) + sqrt(0.2 * log(total)/visits_);
+  Stats stats = unpack(packed_);
+  return stats.value * (player == GOLD ? 1 : -1) + sqrt(0.2 * log(total)/stats.visits);
 }
 
 
@@ -819,22 +821,186 @@ Move ContextMove::getMove() const
 
 float ContextMove::getValue() const 
 { 
-  return move_.getPlayer() == GOLD ? value_ : -1 * value_;
+  float value = unpack(packed_).value;
+  return move_.getPlayer() == GOLD ? value : -1 * value;
+}
+
+//--------------------------------------------------------------------- 
+
+int ContextMove::getVisits() const 
+{ 
+  return unpack(packed_).visits;
 }
 
 //---------------------------------------------------------------------
 
 void ContextMove::update(float sample) {
-  value_ += (sample - value_)/++visits_;  
+  u64 oldPacked;
+  Stats stats;
+  do {
+    oldPacked = packed_;
+    stats = unpack(oldPacked);
+    stats.value += (sample - stats.value)/++stats.visits;  
+  } while (! __sync_bool_compare_and_swap(&packed_, oldPacked, pack(stats)));
+}
+
+//---------------------------------------------------------------------
+
+u64 ContextMove::pack(const Stats& stats)
+{
+  assert(sizeof(Stats) == sizeof(u64));
+  u64 packed;
+  memcpy(&packed, &stats, sizeof(packed));
+  return packed;
+}
+
+//---------------------------------------------------------------------
+
+ContextMove::Stats ContextMove::unpack(u64 packed)
+{
+  Stats stats;
+  memcpy(&stats, &packed, sizeof(stats));
+  return stats;
+}
+
+//---------------------------------------------------------------------
+//  section ContextMoves
+//---------------------------------------------------------------------
+
+ContextMoves::ContextMoves()
+{
+  size_[0] = size_[1] = 0;
+  used_ = 0;
+  users_ = 0;
+  replaced_ = 0;
+  dropped_ = 0;
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+//--------------------------------------------------------------------- 
+
+ContextMoves::~ContextMoves()
+{
+  for (int player = 0; player < 2; player++){
+    for (int i = 0; i < size_[player]; i++){
+      delete moves_[player][i];
+    }
+  }
+  pthread_mutex_destroy(&mutex_);
+}
+
+//--------------------------------------------------------------------- 
+
+bool ContextMoves::add(const Move & move, const Bitboard& bitboard)
+{
+  player_t pl = move.getPlayer();
+  assert(IS_PLAYER(pl));
+
+  //lock free check first - most of the moves are known already
+  int size = size_[pl];
+  if (find(move, bitboard, 0) != -1){
+    return false;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  //moves added meanwhile
+  bool added = find(move, bitboard, size) == -1;
+  if (added && size_[pl] < CONTEXT_MOVES_MAX){
+    moves_[pl][size_[pl]] = new ContextMove(move, bitboard);
+    //publish the move after it is constructed
+    __sync_synchronize();
+    size_[pl]++;
+  }
+  else if (added && users_ == 1){
+    //nobody else reads the moves - the least visited one might go
+    int index = findLeastVisited(pl);
+    delete moves_[pl][index];
+    moves_[pl][index] = new ContextMove(move, bitboard);
+    replaced_++;
+  }
+  else if (added){
+    dropped_++;
+    added = false;
+  }
+  pthread_mutex_unlock(&mutex_);
+  return added;
+}
+
+//--------------------------------------------------------------------- 
+
+void ContextMoves::addUser()
+{
+  __sync_add_and_fetch(&users_, 1);
+}
+
+//--------------------------------------------------------------------- 
+
+void ContextMoves::releaseUser()
+{
+  __sync_sub_and_fetch(&users_, 1);
+}
+
+//--------------------------------------------------------------------- 
+
+void ContextMoves::addUsed(int used)
+{
+  __sync_add_and_fetch(&used_, used);
+}
+
+//--------------------------------------------------------------------- 
+
+int ContextMoves::find(const Move & move, const Bitboard& bitboard, int from) const
+{
+  player_t pl = move.getPlayer();
+  int size = size_[pl];
+  for (int i = from; i < size; i++){
+    if (moves_[pl][i]->applicable(bitboard, move.getStepCount()) && moves_[pl][i]->getMove() == move){
+      return i;
+    }
+  }
+  return -1;
+}
+
+//--------------------------------------------------------------------- 
+
+int ContextMoves::findLeastVisited(player_t player) const
+{
+  int best = 0;
+  for (int i = 1; i < size_[player]; i++){
+    if (moves_[player][i]->getVisits() < moves_[player][best]->getVisits()){
+      best = i;
+    }
+  }
+  return best;
 }
 
 //---------------------------------------------------------------------
 //  section MoveAdvisor
 //---------------------------------------------------------------------
 
-MoveAdvisor::MoveAdvisor() 
+MoveAdvisor::MoveAdvisor(ContextMoves* contextMoves) 
 { 
-  used_ = 0;
+  ownContextMoves_ = contextMoves == NULL;
+  contextMoves_ = ownContextMoves_ ? new ContextMoves() : contextMoves;
+  contextMoves_->addUser();
+  update_ = false;
+}
+
+//--------------------------------------------------------------------- 
+
+MoveAdvisor::~MoveAdvisor() 
+{ 
+  contextMoves_->releaseUser();
+  if (ownContextMoves_){
+    delete contextMoves_;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+ContextMoves* MoveAdvisor::getContextMoves() const
+{
+  return contextMoves_;
 }
 
 //--------------------------------------------------------------------- 
@@ -843,9 +1009,9 @@ bool MoveAdvisor::getMove(player_t player, const Bitboard& bitboard, int stepsLe
 {
   return getMoveRand(player, bitboard, stepsLeft, move);
 
-  for (uint i = 0; i < contextMoves[player].size(); i++) {
-    if (contextMoves[player][i].applicable(bitboard, stepsLeft)){
-      *move = contextMoves[player][i].getMove();
+  for (int i = 0; i < contextMoves_->size(player); i++) {
+    if (contextMoves_->get(player, i).applicable(bitboard, stepsLeft)){
+      *move = contextMoves_->get(player, i).getMove();
       playedCMs[player].push_back(i);
       update_ = true;
       return true;
@@ -858,27 +1024,28 @@ bool MoveAdvisor::getMove(player_t player, const Bitboard& bitboard, int stepsLe
 
 bool MoveAdvisor::getMoveRand(player_t player, const Bitboard& bitboard, int stepsLeft, Move* move)
 {
-  int len = contextMoves[player].size();
+  int len = contextMoves_->size(player);
   if (! len) {
     return false;
   }
   int sample = len;
+  int used = contextMoves_->getUsed();
   float bestValue = INT_MIN;
   int bestIndex = -1;
   //cerr << " ---- " << endl;
   for (int i = 0; i < sample; i++) {
     int index = i; //grand() % len; 
 
-    if ( contextMoves[player][index].applicable(bitboard, stepsLeft)
-     && contextMoves[player][index].urgency(player, used_) > bestValue
-      )
-        {
-      bestIndex = index;
-      bestValue = contextMoves[player][index].urgency(player, used_);
+    if ( contextMoves_->get(player, index).applicable(bitboard, stepsLeft)){
+      float urgency = contextMoves_->get(player, index).urgency(player, used);
+      if (urgency > bestValue){
+        bestIndex = index;
+        bestValue = urgency;
+      }
     }
   }  
   if (bestIndex != -1){
-      *move = contextMoves[player][bestIndex].getMove();
+      *move = contextMoves_->get(player, bestIndex).getMove();
       playedCMs[player].push_back(bestIndex);
       update_ = true;
       //cerr << move->toString() << "/" << contextMoves[player][bestIndex].getValue() << endl;
@@ -891,12 +1058,7 @@ bool MoveAdvisor::getMoveRand(player_t player, const Bitboard& bitboard, int ste
 
 bool MoveAdvisor::addMove(const Move & move, const Bitboard& bitboard)
 {
-  if (! hasMove(move, bitboard)) {
-    //cerr << move.toString() << " " << move.getStepCount() << endl;
-    contextMoves[move.getPlayer()].push_back(ContextMove(move, bitboard));
-    return true;
-  }
-  return false;
+  return contextMoves_->add(move, bitboard);
 }
 
 //--------------------------------------------------------------------- 
@@ -905,31 +1067,19 @@ void MoveAdvisor::update(float sample) {
   if (! update_) {
     return;
   }
+  int used = 0;
   for (player_t player = 0; player < 2; player++){
     for (list<int>::const_iterator it = playedCMs[player].begin(); 
           it != playedCMs[player].end(); it++){
-      contextMoves[player][*it].update(sample);
-      used_++;
+      contextMoves_->get(player, *it).update(sample);
+      used++;
     }
     playedCMs[player].clear();
   }
+  contextMoves_->addUsed(used);
   update_ = false;
 }
 
-//--------------------------------------------------------------------- 
-
-bool MoveAdvisor::hasMove(const Move & move, const Bitboard& bitboard){
-  player_t pl = move.getPlayer();
-  assert(IS_PLAYER(pl));
-  for (ContextMoves::const_iterator it = contextMoves[pl].begin(); 
-                                       it != contextMoves[pl].end(); it++){
-    if (it->applicable(bitboard, move.getStepCount()) && it->getMove() == move){
-      return true;
-    }
-  }
-  return false;
-}
-
 
 //---------------------------------------------------------------------
 //  section Board
@@ -2099,6 +2249,10 @@ void* Board::operator new(size_t size) {
 //--------------------------------------------------------------------- 
 
 void Board::operator delete(void* p) {
+  if (glob.bpool()->size() >= BPOOL_MAX_SIZE) {
+    free(p);
+    return;
+  }
   glob.bpool()->push(static_cast<Board*> (p));
   //Board* b = static_cast<Board*>(p);
   //free(b);
@@ -2533,6 +2687,37 @@ int Board::filterRepetitions(StepArray& steps, int stepsNum) const
 
 //---------------------------------------------------------------------
 
+int Board::filterCommuting(StepArray& steps, int stepsNum) const 
+{
+  //first step of the move
+  if (stepCount_ == 0){
+    return stepsNum;
+  }
+
+  int kept = 0;
+  for (int i = 0; i < stepsNum; i++){
+    if (! (steps[i] < lastStep_ && steps[i].commutes(lastStep_))){
+      kept++;
+    }
+  }
+  if (kept == 0 || kept == stepsNum){
+    return stepsNum;
+  }
+
+  int i = 0;
+  while (i < stepsNum){
+    if (steps[i] < lastStep_ && steps[i].commutes(lastStep_)){
+      steps[i] = steps[--stepsNum];
+    }
+    else{
+      i++;  
+    }
+  }
+  return stepsNum;
+}
+
+//---------------------------------------------------------------------
+
 bool Board::stepIsVirtualPass(Step& step) const 
 {
   u64 afterStepSignature = calcAfterStepSignature(step);
@@ -2580,6 +2765,13 @@ uint Board::getStepCountLeft() const
 
 //--------------------------------------------------------------------- 
 
+uint Board::getMoveCount() const
+{
+  return moveCount_;
+}
+
+//--------------------------------------------------------------------- 
+
 u64 Board::getPreMoveSignature() const
 {
   return preMoveSignature_; 
@@ -87,6 +87,9 @@ typedef unsigned long long u64;
 
 #define OLD_PLAYER_TO_NEW(player) (player == 16 ? GOLD : SILVER)
 
+//zobrist keys are generated from the fixed seed
+#define ZOBRIST_SEED 1244026459
+
 typedef int player_t;
 typedef int piece_t;
 typedef int coord_t;
@@ -324,6 +327,16 @@ class Step
      */
     bool inversed(const Step&) const;
 
+    /**
+     * Checks whether steps are independent.
+     *
+     * Independent steps reach the same position in any order. 
+     * Squares touched by the steps must be at least 3 squares apart 
+     * (freezing, push/pull support and trap captures reach one square).
+     * @return False for pass/no step.
+     */
+    bool commutes(const Step&) const;
+
     /**
      * Checks whether step moves any piece. 
      *
@@ -357,6 +370,7 @@ class Step
     friend class OB_Board;
     friend class ContextMove;
     friend class Move;
+    friend class TWsteps;
   
   private: 
     /**
@@ -510,38 +524,59 @@ typedef float  HeurArray[MAX_STEPS];
 typedef list<int> intList;
 
 typedef stack<Board*> Bpool;
+//recycled boards kept by one thread 
+#define BPOOL_MAX_SIZE 32
 
 typedef u64 Bitboard[2][7];
 
+/**
+ * Per thread search context. 
+ *
+ * Objects which must not be shared by search threads.
+ */
+class SearchContext {
+  public:
+    SearchContext(unsigned int seed);
+    ~SearchContext();
+
+    /**Recycled boards (bounded by BPOOL_MAX_SIZE).*/
+    Bpool bpool;
+    ThirdRep thirdRep;
+    Grand grand;
+};
+
 class Glob {
   public:
     Glob();
-    void init();
-    inline Bpool* bpool() {return bpool_[tti()];}
-    inline ThirdRep* thirdRep() {return thirdRep_[tti()];}
-    inline Grand* grand() {return grand_[tti()];}
+
+    /**
+     * Releases search context of the calling thread. 
+     *
+     * Must be called by threads leaving before the program ends.
+     */
+    void releaseThread();
+
+    inline Bpool* bpool() {return &context()->bpool;}
+    inline ThirdRep* thirdRep() {return &context()->thirdRep;}
+    inline Grand* grand() {return &context()->grand;}
 
   private:
     /**
-     * Thread to index.
+     * Context of the calling thread (created on first use).
      */
-    int tti();
+    inline SearchContext* context() {return context_ ? context_ : add_thread();}
     
     /**
      * Adds new thread.
      *
-     * Creates global objects for given thread and returns 
-     * it's index.
+     * Creates search context for the calling thread. 
      */
-    int add_thread();
+    SearchContext* add_thread();
 
-    int threadIds_[MAX_THREADS];
-    int threadsNum_ ;
+    static __thread SearchContext* context_;
 
+    /**Guards seeding (rand() is not thread safe).*/
     pthread_mutex_t lock;
-    Bpool * bpool_[MAX_THREADS];
-    ThirdRep * thirdRep_[MAX_THREADS];
-    Grand * grand_[MAX_THREADS];
 };
 
 extern Glob glob;
@@ -567,6 +602,14 @@ class ContextMove
 
     float getValue() const;
 
+    /**
+     * Number of playouts the move was played in.
+     */
+    int getVisits() const;
+
+    /**
+     * Atomic update with playout sample.
+     */
     void update(float sample); 
 
     /**
@@ -575,25 +618,131 @@ class ContextMove
     float urgency(player_t player, int total) const;
   private: 
     ContextMove(){};
+
+    struct Stats {
+      float value;
+      int visits;
+    };
+
+    static u64 pack(const Stats& stats);
+    static Stats unpack(u64 packed);
+
     Move move_;
     Bitboard context_;
     u64 mask_;
-    float value_;
-    int visits_;
+    /**Packed Stats (context move might be shared by search threads).*/
+    volatile u64 packed_;
 };
 
-typedef vector<ContextMove> ContextMoves;
-typedef ContextMoves::iterator ContextMovesIter;
+//maximal number of context moves for one player 
+#define CONTEXT_MOVES_MAX 4096
+
+/**
+ * Store of context moves.
+ *
+ * Might be shared by advisors of more search threads. Readers don't lock, 
+ * insertion is guarded by the mutex and the move is published by 
+ * incrementing the size. Full store replaces its least visited move 
+ * only if it has a single user (nobody reads concurrently), otherwise 
+ * new moves are dropped.
+ */
+class ContextMoves
+{
+  public:
+    ContextMoves();
+    ~ContextMoves();
+
+    /**
+     * Number of moves of the player.
+     */
+    inline int size(player_t player) const { return size_[player]; }
+
+    inline ContextMove& get(player_t player, int index) { return *moves_[player][index]; }
+
+    /**
+     * Adds move if there is no such move already.
+     *
+     * @return True if move was added.
+     */
+    bool add(const Move & move, const Bitboard& bitboard);
+
+    /**
+     * Registers a user (advisor, concurrent filler) of the store.
+     */
+    void addUser();
+
+    /**
+     * Unregisters a user of the store.
+     */
+    void releaseUser();
+
+    /**
+     * Number of moves which replaced a least visited one in the full store.
+     */
+    inline int getReplaced() const { return replaced_; }
+
+    /**
+     * Number of moves dropped because the (shared) store was full.
+     */
+    inline int getDropped() const { return dropped_; }
+
+    /**
+     * Total number of updates (of all moves).
+     */
+    inline int getUsed() const { return used_; }
+
+    /**
+     * Atomically adds to the total number of updates.
+     */
+    void addUsed(int used);
+
+  private:
+    ContextMoves(const ContextMoves&);
+    ContextMoves& operator=(const ContextMoves&);
+
+    /**
+     * Index of the move in [from, size) or -1.
+     */
+    int find(const Move & move, const Bitboard& bitboard, int from) const;
+
+    /**
+     * Index of the least visited move of the player.
+     */
+    int findLeastVisited(player_t player) const;
+
+    ContextMove* moves_[2][CONTEXT_MOVES_MAX];
+    volatile int size_[2];
+    volatile int used_;
+    /**Number of users - moves are replaced only with one user.*/
+    volatile int users_;
+    int replaced_;
+    int dropped_;
+    /**Guards insertion.*/
+    pthread_mutex_t mutex_;
+};
 
 /**
  * Move advisor.
  *
- * Mechanism for propagating good moves to playouts.
+ * Mechanism for propagating good moves to playouts. Context moves might 
+ * be shared with advisors of other threads, played moves (waiting 
+ * for the update) belong to the advisor.
  */
 class MoveAdvisor 
 {
   public: 
-    MoveAdvisor(); 
+    /**
+     * @param contextMoves Store shared with other advisors 
+     *                     (NULL means advisor uses its own one).
+     */
+    MoveAdvisor(ContextMoves* contextMoves=NULL); 
+    ~MoveAdvisor(); 
+
+    /**
+     * Store of the context moves.
+     */
+    ContextMoves* getContextMoves() const;
+
     /**
      * Get move for given conditions.
      */
@@ -615,18 +764,19 @@ class MoveAdvisor
     void update(float sample);
 
   private:
-    bool hasMove(const Move & move, const Bitboard& bitboard);
+    MoveAdvisor(const MoveAdvisor&);
+    MoveAdvisor& operator=(const MoveAdvisor&);
 
     //void bubble(player_t player, int index, direction
 
-    ContextMoves contextMoves[2];
+    ContextMoves* contextMoves_;
+    /**Whether contextMoves_ belongs to this advisor.*/
+    bool ownContextMoves_;
     /**List of played indexes.*/
     list<int> playedCMs[2];
 
     /**Flag saying whether update is needed*/
     bool update_;
-    
-    int used_;
 };
     
 /**
@@ -744,6 +894,15 @@ class Board
      * */
     int filterRepetitions(StepArray&, int ) const;
 
+    /**
+     * Canonical order of independent steps within the move.
+     *
+     * Step commuting with the previous step of the move is kept only 
+     * if it doesn't precede it in the step order - the other order 
+     * reaches the same position. Steps are kept if all would be filtered.
+     */
+    int filterCommuting(StepArray&, int ) const;
+
     /**
      * Setup pieces phase test.
      *
@@ -868,6 +1027,11 @@ class Board
      */
     u64 getSignature() const;
 
+    /**
+     * Pre move signature getter.
+     */
+    u64 getPreMoveSignature() const;
+
     /**
      * Winner getter. 
      */
@@ -898,6 +1062,11 @@ class Board
      */
 	  uint getStepCount() const;
 
+    /**
+     * Move number getter (increased after silver's move).
+     */
+	  uint getMoveCount() const;
+
     /**
      * Steps left. 
      */
@@ -1098,11 +1267,6 @@ class Board
      */
     bool stepIsThirdRepetition(const Step& ) const;
 
-    /**
-     * Pre move signature getter.
-     */
-    u64 getPreMoveSignature() const;
-
     Bitboard bitboard_;
 
     static bool       classInit;
@@ -108,6 +108,27 @@ Cfg::Cfg()
   items_.push_back(CfgItem("active_trapping", IT_FLOAT, (void*)&activeTrapping_,"0"));
   items_.push_back(CfgItem("knowledge_tournament_size", IT_INT, (void*)&knowledgeTournamentSize_,"3"));
   items_.push_back(CfgItem("search_threads_num", IT_INT, (void*)&searchThreadsNum_,"1"));
+  items_.push_back(CfgItem("progressive_widening", IT_BOOL, (void*)&progressiveWidening_,"0"));
+  items_.push_back(CfgItem("pw_init_children", IT_INT, (void*)&pwInitChildren_,"5"));
+  items_.push_back(CfgItem("pw_exponent", IT_FLOAT, (void*)&pwExponent_,"0.5"));
+  items_.push_back(CfgItem("uct_max_nodes", IT_INT, (void*)&maxNodes_,"0"));
+  items_.push_back(CfgItem("board_snapshots", IT_INT, (void*)&boardSnapshots_,"4096"));
+  items_.push_back(CfgItem("shared_history", IT_BOOL, (void*)&sharedHistory_,"0"));
+  items_.push_back(CfgItem("tactics_threads", IT_INT, (void*)&tacticsThreads_,"0"));
+  items_.push_back(CfgItem("shared_advisor", IT_BOOL, (void*)&sharedAdvisor_,"0"));
+  items_.push_back(CfgItem("tree_reuse", IT_BOOL, (void*)&treeReuse_,"1"));
+  items_.push_back(CfgItem("early_stop", IT_BOOL, (void*)&earlyStop_,"1"));
+  items_.push_back(CfgItem("instant_reply", IT_BOOL, (void*)&instantReply_,"1"));
+  items_.push_back(CfgItem("move_tree", IT_BOOL, (void*)&moveTree_,"0"));
+  items_.push_back(CfgItem("canonical_steps", IT_BOOL, (void*)&canonicalSteps_,"1"));
+  items_.push_back(CfgItem("search_playouts", IT_INT, (void*)&searchPlayouts_,"0"));
+  items_.push_back(CfgItem("search_nodes", IT_INT, (void*)&searchNodes_,"0"));
+  items_.push_back(CfgItem("search_seed", IT_INT, (void*)&searchSeed_,"0"));
+  items_.push_back(CfgItem("shared_tt", IT_BOOL, (void*)&sharedTT_,"0"));
+  items_.push_back(CfgItem("shared_tree", IT_BOOL, (void*)&sharedTree_,"0"));
+  items_.push_back(CfgItem("leaf_parallel_threads", IT_INT, (void*)&leafParallelThreads_,"0"));
+  items_.push_back(CfgItem("thread_affinity", IT_BOOL, (void*)&threadAffinity_,"0"));
+  items_.push_back(CfgItem("root_workers_num", IT_INT, (void*)&rootWorkersNum_,"0"));
   //items_.push_back(CfgItem("evaluation_config", IT_STR, (void*)&evalCfg_,""));
   evaluationValues_ = NULL; 
   stepKnowledgeValues_ = NULL; 
@@ -186,19 +207,8 @@ void Cfg::loadFromSection(string content)
   while (ss.good()){
     ss >> name;
     ss >> value; 
-    bool found = false;
-    for (CfgItemListIter it = items_.begin(); it != items_.end(); it++){
-      if (it->name_ == name) {
-        it->set_ = true;
-        if (! fillItemFromString(it->item_, it->type_, value)){
-            logError("Unknown option type.");
-            exit(1);
-        }
-        found = true; 
-      } 
-    }
-    if (! found){
-      logError("Unknown option %s.", name.c_str());
+    if (! setItem(name, value)){
+      logError("Unknown option %s or its type.", name.c_str());
       exit(1);
     }
   }
@@ -206,6 +216,19 @@ void Cfg::loadFromSection(string content)
 
 //--------------------------------------------------------------------- 
 
+bool Cfg::setItem(string name, string value)
+{
+  for (CfgItemListIter it = items_.begin(); it != items_.end(); it++){
+    if (it->name_ == name) {
+      it->set_ = true;
+      return fillItemFromString(it->item_, it->type_, value);
+    } 
+  }
+  return false;
+}
+
+//--------------------------------------------------------------------- 
+
 bool Cfg::checkConfiguration()
 {
   bool res = true;
@@ -233,6 +256,8 @@ Options::Options()
   localMode_ = OptionBool("e","extended","Use AEI extended set (for development purposes).",OT_BOOL_POS, false);
   getMoveMode_ = OptionBool("g","getmove","Toggle getMove mode.",OT_BOOL_POS, false);
   help_ = OptionBool("h", "help", "Print this help.", OT_BOOL_POS, false);
+  workerAddress_ = OptionString("w","worker","Run as root parallelization worker of coordinator host:port.", OT_STRING, "");
+  playouts_ = OptionInt("n","playouts","Deterministic search of given number of playouts - in combination with -g.", OT_INT, 0);
 
   options_.clear();
   options_.push_back(&fnAeiInit_);
@@ -241,6 +266,8 @@ Options::Options()
   options_.push_back(&localMode_);
   options_.push_back(&getMoveMode_);
   options_.push_back(&help_);
+  options_.push_back(&workerAddress_);
+  options_.push_back(&playouts_);
 
   values_.clear();
   //order in which options are expected is important
@@ -75,6 +75,13 @@ class Cfg
      * Checks whether every item has been set.
      */
     bool checkConfiguration();
+
+    /**
+     * Sets item of given name from string value. 
+     *
+     * @return False if there is no such item or value is malformed.
+     */
+    bool setItem(string name, string value);
     
     inline bool localPlayout() { return localPlayout_; }
     inline bool useBestEval() { return useBestEval_; }
@@ -98,6 +105,27 @@ class Cfg
     inline bool playoutByMoves() { return playoutByMoves_; }
     inline uint knowledgeTournamentSize() { return knowledgeTournamentSize_; }
     inline int searchThreadsNum() { return searchThreadsNum_; }
+    inline bool progressiveWidening() { return progressiveWidening_; }
+    inline int pwInitChildren() { return pwInitChildren_; }
+    inline float pwExponent() { return pwExponent_; }
+    inline int maxNodes() { return maxNodes_; }
+    inline int boardSnapshots() { return boardSnapshots_; }
+    inline bool sharedHistory() { return sharedHistory_; }
+    inline int tacticsThreads() { return tacticsThreads_; }
+    inline bool sharedAdvisor() { return sharedAdvisor_; }
+    inline bool treeReuse() { return treeReuse_; }
+    inline bool earlyStop() { return earlyStop_; }
+    inline bool instantReply() { return instantReply_; }
+    inline bool moveTree() { return moveTree_; }
+    inline bool canonicalSteps() { return canonicalSteps_; }
+    inline int searchPlayouts() { return searchPlayouts_; }
+    inline int searchNodes() { return searchNodes_; }
+    inline int searchSeed() { return searchSeed_; }
+    inline bool sharedTT() { return sharedTT_; }
+    inline bool sharedTree() { return sharedTree_; }
+    inline int leafParallelThreads() { return leafParallelThreads_; }
+    inline bool threadAffinity() { return threadAffinity_; }
+    inline int rootWorkersNum() { return rootWorkersNum_; }
     inline string evalCfg() { return evalCfg_; }
 
     inline EvaluationValues* evaluationValues() {return evaluationValues_;}
@@ -150,6 +178,48 @@ class Cfg
     uint knowledgeTournamentSize_;
     /**Number of threads for search.*/
     int searchThreadsNum_;
+    /**Create children of expanded node gradually.*/
+    bool progressiveWidening_;
+    /**Number of children created at expansion (with progressive widening).*/
+    int pwInitChildren_;
+    /**Children grow as visits to the power of this (with progressive widening).*/
+    float pwExponent_;
+    /**Limit on nodes in one search tree (0 means no limit).*/
+    int maxNodes_;
+    /**Size of board snapshots cache in the tree (0 means no cache).*/
+    int boardSnapshots_;
+    /**History heuristic table shared by search threads.*/
+    bool sharedHistory_;
+    /**Number of helper threads running tactics of expanded nodes (0 means synchronous).*/
+    int tacticsThreads_;
+    /**Context moves of the move advisor shared by search threads.*/
+    bool sharedAdvisor_;
+    /**Tree of the last search is reused in the next one.*/
+    bool treeReuse_;
+    /**Search stops once the best move can't be overtaken.*/
+    bool earlyStop_;
+    /**Goal and the only legal move are answered without search.*/
+    bool instantReply_;
+    /**Search tree with full moves as edges (single thread) instead of steps.*/
+    bool moveTree_;
+    /**Independent steps of the move are expanded in one (canonical) order only.*/
+    bool canonicalSteps_;
+    /**Search stops after this number of playouts (all threads, 0 = time controls).*/
+    int searchPlayouts_;
+    /**Search stops when tree of a thread has this number of nodes (0 = time controls).*/
+    int searchNodes_;
+    /**Seed of the search (0 = time), fixed seed with a budget makes search deterministic.*/
+    int searchSeed_;
+    /**Statistics of positions shared by search threads (lock free table).*/
+    bool sharedTT_;
+    /**All search threads descend one tree.*/
+    bool sharedTree_;
+    /**Number of helper threads running playouts from the leaf (per search thread).*/
+    int leafParallelThreads_;
+    /**Pin search threads (and leaf workers) to cores.*/
+    bool threadAffinity_;
+    /**Number of worker processes for root parallelization.*/
+    int rootWorkersNum_;
     /**Filename to take the evaluation configuration from.*/
     string evalCfg_;
 
@@ -250,6 +320,10 @@ class Options
     OptionBool localMode_;
     /**Print help.*/
     OptionBool help_;
+    /**Coordinator address - switch to root parallelization worker mode.*/
+    OptionString workerAddress_;
+    /**Deterministic search of given number of playouts - for getMoveMode_.*/
+    OptionInt playouts_;
 
   public:
     Options();
@@ -267,6 +341,8 @@ class Options
     string fnRecord() { return fnRecord_.getValue(); }
     string fnGameState() { return fnGameState_.getValue(); }
     string fnCfg() { return fnCfg_.getValue(); }
+    string workerAddress() { return workerAddress_.getValue(); }
+    int playouts() { return playouts_.getValue(); }
 
     void printAll();
     string helpToString();
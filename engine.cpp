@@ -1,5 +1,6 @@
 
 #include "engine.h"
+#include "remote.h"
 
 //---------------------------------------------------------------------
 //  section TimeManager
@@ -10,15 +11,29 @@ TimeManager::TimeManager()
   for (int i = 0; i < TIME_CONTROLS_NUM; i++)
     timeControls_[i] = 0;
   noTimeLimit_ = false;
+  stopLatency_ = -1;
+  early_ = false;
+  extended_ = 0;
+  timeSaved_ = 0;
   timeControls_[TC_MOVE] = TC_MOVE_DEFAULT;
+  player_ = NO_PLAYER;
+  reserve_[GOLD] = reserve_[SILVER] = 0;
+  target_ = extendedTarget_ = limit_ = 0;
 }
 
 //--------------------------------------------------------------------- 
 
-void TimeManager::startClock()
+void TimeManager::startClock(player_t player, int moveCount)
 {
-  timer.setTimer(timeControls_[TC_MOVE] - CLOCK_CLICK_RESERVE);
+  player_ = player;
+  computeBudget(player, moveCount);
+  timer.setTimer(limit_);
   timer.start();
+  early_ = false;
+  extended_ = 0;
+  timeSaved_ = 0;
+  //search is stopped at the target unless the best move is unstable (extendTarget)
+  deadline_.arm(target_);
 }
 
 //--------------------------------------------------------------------- 
@@ -26,19 +41,141 @@ void TimeManager::startClock()
 void TimeManager::stopClock()
 {
   timer.stop();
+  deadline_.disarm();
+  stopLatency_ = timeUp() && ! early_ ? Timer::now() - deadline_.getDeadline() : -1;
+
+  if (noTimeLimit_ || ! IS_PLAYER(player_)){
+    return;
+  }
+  //reserve accounting
+  double move = timeControls_[TC_MOVE];
+  double used = timer.elapsed() + timeControls_[TC_MOVE_USED];
+  double& reserve = reserve_[player_];
+  if (used <= move){
+    reserve += (move - used) * timeControls_[TC_PERCENT] / 100;
+  }
+  else{
+    reserve = max(reserve - (used - move), 0.0);
+  }
+  if (timeControls_[TC_MAX] > 0){
+    reserve = min(reserve, double(timeControls_[TC_MAX]));
+  }
+  timeControls_[TC_MOVE_USED] = 0;
+}
+
+//---------------------------------------------------------------------
+
+void TimeManager::computeBudget(player_t player, int moveCount)
+{
+  const float* tc = timeControls_;
+  double move = tc[TC_MOVE] - tc[TC_MOVE_USED];
+  double reserve = IS_PLAYER(player) ? reserve_[player] : 0;
+  int turnsLeft = tc[TC_TURNS] > 0 ? max(int(tc[TC_TURNS]) - moveCount + 1, 1) : 
+                                     EXPECTED_TURNS_LEFT;
+
+  //move time is never wasted, reserve is spread over next moves
+  target_ = move + reserve / min(turnsLeft, RESERVE_SPREAD);
+  //losing on time is avoided 
+  limit_ = move + reserve;
+  if (tc[TC_TURN_TIME] > 0){
+    limit_ = min(limit_, double(tc[TC_TURN_TIME] - tc[TC_MOVE_USED]));
+  }
+  //total game time is shared by both players 
+  if (tc[TC_TOTAL] > 0){
+    double gameLeft = tc[TC_TOTAL] - tc[TC_W_USED] - tc[TC_B_USED];
+    target_ = min(target_, gameLeft / (2 * turnsLeft));
+    limit_ = min(limit_, gameLeft);
+  }
+
+  limit_ = max(limit_ - CLOCK_CLICK_RESERVE, MIN_SEARCH_TIME);
+  target_ = min(max(target_ - CLOCK_CLICK_RESERVE, MIN_SEARCH_TIME), limit_);
+  extendedTarget_ = min(target_ * TIME_EXTENSION_RATIO, limit_);
 }
 
 //---------------------------------------------------------------------
 
 bool TimeManager::timeUp()
 {
-  if ( noTimeLimit_ || ! timer.timeUp())
+  if ( noTimeLimit_ || ! (early_ || deadline_.expired()))
     return false;
   return true;
 }
 
 //---------------------------------------------------------------------
 
+void TimeManager::stopEarly()
+{
+  if (noTimeLimit_ || early_){
+    return;
+  }
+  timeSaved_ = max(secondsLeft(), 0.0);
+  early_ = true;
+}
+
+//---------------------------------------------------------------------
+
+bool TimeManager::canExtendTarget()
+{
+  return ! noTimeLimit_ && ! early_ && extendedTarget_ > target_ && 
+         (! extended_ || timer.running() < extendedTarget_);
+}
+
+//---------------------------------------------------------------------
+
+bool TimeManager::extendTarget()
+{
+  //the first thread rearms, others might still see the flag of the target
+  if (__sync_bool_compare_and_swap(&extended_, 0, 1)){
+    deadline_.arm(max(extendedTarget_ - timer.running(), 0.0));
+    return true;
+  }
+  return timer.running() < extendedTarget_;
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::timeSaved()
+{
+  return timeSaved_;
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::getTarget()
+{
+  return target_;
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::getLimit()
+{
+  return limit_;
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::secondsRunning()
+{
+  return timer.running();
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::secondsLeft()
+{
+  return target_ - timer.running();
+}
+
+//---------------------------------------------------------------------
+
+double TimeManager::stopLatency()
+{
+  return stopLatency_;
+}
+
+//---------------------------------------------------------------------
+
 double TimeManager::secondsElapsed()
 {
   return timer.elapsed();
@@ -52,6 +189,17 @@ void TimeManager::setTimeControl(timeControl_e tc, float value)
 
   if ( tc >= 0 && tc < TIME_CONTROLS_NUM)
     timeControls_[tc] = value;
+
+  //reserves from aei replace the tracked ones
+  if (tc == TC_RESERVE){
+    reserve_[GOLD] = reserve_[SILVER] = value;
+  }
+  if (tc == TC_W_RESERVE){
+    reserve_[GOLD] = value;
+  }
+  if (tc == TC_B_RESERVE){
+    reserve_[SILVER] = value;
+  }
 }
 
 //--------------------------------------------------------------------- 
@@ -74,6 +222,13 @@ void TimeManager::setNoTimeLimit()
 
 //--------------------------------------------------------------------- 
 
+bool TimeManager::isNoTimeLimit()
+{
+  return noTimeLimit_; 
+}
+
+//--------------------------------------------------------------------- 
+
 void TimeManager::resetSettings()
 {
   noTimeLimit_ = false;
@@ -91,13 +246,39 @@ Engine::Engine()
   additionalInfo_ = "";
   stats_ = "";
   winRatio_ = 0.5;
+  playoutsNum_ = 0;
+  searchPool_ = NULL;
+  remoteWorkers_ = NULL;
+  sharedTT_ = NULL;
+  tacticsPool_ = NULL;
+  lastUct_ = NULL;
+  lastBoard_ = NULL;
+  reusedVisits_ = 0;
+  ponderUct_ = NULL;
+  ponderBoard_ = NULL;
+  ponderHits_ = 0;
+  pondered_ = 0;
+  earlyStop_ = false;
+  deterministic_ = false;
+  instantReplies_ = 0;
+  movesAnswered_ = 0;
 }
 
 //--------------------------------------------------------------------- 
 
 Engine::~Engine()
 {
+  delete searchPool_;
+  delete remoteWorkers_;
+  delete sharedTT_;
+  delete tacticsPool_;
+  delete lastUct_;
+  delete lastBoard_;
+  delete ponderUct_;
+  delete ponderBoard_;
   delete timeManager_;
+  //trees are gone - their tables too
+  Tree::freeTTpool();
 }
 
 //--------------------------------------------------------------------- 
@@ -120,6 +301,41 @@ void Engine::doSearch(const Board* board)
     return;
   }
 
+  resolvePonder(board);
+  //pondering is not answered 
+  if (! ponder_){
+    movesAnswered_++;
+    if (cfg.instantReply() && instantReply(board)){
+      return;
+    }
+  }
+
+  //fixed budget replaces time controls
+  deterministic_ = false;
+  if (cfg.searchPlayouts() > 0 || cfg.searchNodes() > 0){
+    timeManager_->setNoTimeLimit();
+    deterministic_ = cfg.searchSeed() != 0;
+  }
+  //keys of hash tables of the trees are drawn from the seed as well
+  if (deterministic_){
+    srand(cfg.searchSeed());
+  }
+
+  if (cfg.moveTree()){
+    moveTreeSearch(board);
+    return;
+  }
+
+  //pondering searches the position after the expected reply
+  Move ponderMove;
+  Board* ponderBoard = ponder_ && ! deterministic_ ? predictReply(board, ponderMove) : NULL;
+  string ponderMoveRepr = "";
+  if (ponderBoard){
+    ponderMoveRepr = board->moveToStringWithKills(ponderMove);
+    pondered_++;
+    board = ponderBoard;
+  }
+
   int threadsNum = cfg.searchThreadsNum();
 
   if (threadsNum < 0){
@@ -131,48 +347,135 @@ void Engine::doSearch(const Board* board)
     threadsNum = MAX_THREADS;
   }
 
-  glob.init();
+  //deterministic search runs the search threads only 
+  int leafWorkersNum = deterministic_ ? 0 : max(cfg.leafParallelThreads(), 0);
+  if (leafWorkersNum > MAX_THREADS){
+    logWarning("Too many leaf threads falling back to %d", MAX_THREADS);
+    leafWorkersNum = MAX_THREADS;
+  }
 
-  pthread_t threads[MAX_THREADS];
-  Uct* ucts[MAX_THREADS];
-  pthread_attr_t attr;
-  int rc, t;
-  void *status;
+  //threads are kept from the previous search if possible
+  if (! searchPool_ || searchPool_->getThreadsNum() != threadsNum || 
+      searchPool_->getLeafWorkersNum() != leafWorkersNum || 
+      searchPool_->getThreadAffinity() != cfg.threadAffinity()){
+    delete searchPool_;
+    searchPool_ = new SearchPool(threadsNum, leafWorkersNum);
+  }
 
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  int remoteWorkersNum = deterministic_ ? 0 : max(cfg.rootWorkersNum(), 0);
+  if (! remoteWorkersNum || (remoteWorkers_ && remoteWorkers_->getRequestedNum() != remoteWorkersNum)){
+    delete remoteWorkers_;
+    remoteWorkers_ = NULL;
+  }
+  if (remoteWorkersNum && ! remoteWorkers_){
+    remoteWorkers_ = new RemoteWorkers(remoteWorkersNum);
+  }
 
-  stopRequest_ = false;
-  timeManager_->startClock();
+  //values of positions are shared by the (separate) trees of threads 
+  bool useSharedTT = cfg.sharedTT() && threadsNum > 1 && ! cfg.sharedTree() && ! deterministic_;
+  if (useSharedTT && ! sharedTT_){
+    sharedTT_ = new SharedTT();
+  }
+  if (sharedTT_){
+    sharedTT_->newSearch();
+  }
 
-  Uct* masterUct  = cfg.searchThreadsNum() > 1 ? new Uct(board) : NULL;
+  int tacticsThreadsNum = min(max(cfg.tacticsThreads(), 0), MAX_THREADS);
+  if (tacticsPool_ && tacticsPool_->getWorkersNum() != tacticsThreadsNum){
+    delete tacticsPool_;
+    tacticsPool_ = NULL;
+  }
+  if (tacticsThreadsNum && ! tacticsPool_){
+    tacticsPool_ = new TaskPool(tacticsThreadsNum);
+  }
 
+  Uct* ucts[MAX_THREADS];
+  int t;
   for(t=0; t<threadsNum; t++){
-    ucts[t] = new Uct(board, masterUct);
-    SearchStartKit * s = new SearchStartKit(board, this, ucts[t]);
-    rc = pthread_create(&threads[t], &attr, Engine::searchTreeWrapper,(void*) s); 
-    if (rc) {
-      stringstream ss;
-      ss << "Fatal thread error no. " << rc << " when creating.";
-      logError(ss.str().c_str());
-      exit(1);
-    } 
-  } 
+    ucts[t] = NULL;
+  }
 
-  for(t=0; t<threadsNum; t++){
-    rc = pthread_join(threads[t], &status); 
-    if (rc) {
-      stringstream ss;
-      ss << "Fatal thread error no. " << rc << " when joining.";
-      logWarning(ss.str().c_str());
-      pthread_detach(threads[t]);
+  stopRequest_ = false;
+  timeManager_->startClock(board->getPlayerToMove(), board->getMoveCount());
+
+  //searched tree is the one of the only thread or the master's (shared tree)
+  //deterministic search doesn't depend on the previous searches
+  bool reuse = cfg.treeReuse() && (threadsNum == 1 || cfg.sharedTree()) && ! deterministic_;
+  //remote workers search their own trees
+  earlyStop_ = cfg.earlyStop() && (threadsNum == 1 || cfg.sharedTree()) && ! remoteWorkers_;
+  Uct* reusedUct = NULL;
+  reusedVisits_ = 0;
+  if (lastUct_){
+    const Node* node = reuse ? 
+      lastUct_->getTree()->findPosition(lastBoard_, board, TREE_REUSE_MAX_MOVES, TREE_REUSE_MIN_VISITS) : NULL;
+    if (node){
+      reusedUct = new Uct(board, lastUct_, node);
+      reusedVisits_ = node->getVisits();
+    }
+    //opponent might play another move than the expected one
+    if (! ponderBoard){
+      delete lastUct_;
+      delete lastBoard_;
+      lastUct_ = NULL;
+      lastBoard_ = NULL;
+    }
+  }
+
+  Uct* masterUct  = NULL;
+  if (threadsNum > 1){
+    masterUct = reusedUct ? reusedUct : new Uct(board);
+  }
+  else{
+    ucts[0] = reusedUct;
+  }
+  //separate trees (not connected to the master) are created in the thread order
+  if (deterministic_){
+    for(t=0; t<threadsNum; t++){
+      if (! ucts[t]){
+        ucts[t] = new Uct(board);
+      }
     }
   }
+
+  if (remoteWorkers_){
+    remoteWorkers_->startSearch(board);
+  }
+  searchPool_->search(board, this, ucts, masterUct, useSharedTT ? sharedTT_ : NULL, 
+                      deterministic_ ? NULL : tacticsPool_);
+  //stop latency is measured on the search threads only
   timeManager_->stopClock();
+  if (remoteWorkers_){
+    remoteWorkers_->stopSearch();
+  }
+
   mockupSearchResults(board, ucts, masterUct, threadsNum); 
+  if (ponderBoard){
+    stats_ += "  pondering after the expected reply " + ponderMoveRepr + "\n";
+  }
 
+  //searched tree is kept for the next search (pondered one until the opponent moves)
+  Uct* keptUct = NULL;
+  if (reuse){
+    keptUct = masterUct ? masterUct : ucts[0];
+    if (ponderBoard){
+      ponderUct_ = keptUct;
+      ponderBoard_ = ponderBoard;
+      ponderBoard = NULL;
+    }
+    else{
+      lastUct_ = keptUct;
+      lastBoard_ = new Board(*board);
+    }
+  }
+  delete ponderBoard;
   for(t=0; t<threadsNum; t++){
-    delete ucts[t];
+    if (ucts[t] != keptUct){
+      delete ucts[t];
+    }
+  }
+  //master goes last - (shared tree) views point to its nodes
+  if (masterUct != keptUct){
+    delete masterUct;
   }
 }
 
@@ -234,9 +537,322 @@ float Engine::getWinRatio() const
 
 //--------------------------------------------------------------------- 
 
-bool Engine::checkSearchStop() const
+int Engine::getPlayoutsNum() const
+{
+  return playoutsNum_;
+}
+
+//--------------------------------------------------------------------- 
+
+vector<int> Engine::getThreadPlayouts() const
+{
+  return threadPlayouts_;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::checkSearchStop(const Uct* uct, bool periodic) const
+{
+  if (stopRequest_){
+    return true;
+  }
+  if (timeManager_->timeUp()){
+    //unstable best move gets the time up to the extended target
+    return ! (uct && timeManager_->canExtendTarget() && bestMoveUnstable(uct) && 
+              timeManager_->extendTarget());
+  }
+  //best move is settled 
+  if (uct && periodic && earlyStop_ && bestMoveSettled(uct)){
+    timeManager_->stopEarly();
+    return true;
+  }
+  return false;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::checkSearchStop(const MoveUct* uct) const
+{
+  if (stopRequest_){
+    return true;
+  }
+  if (timeManager_->timeUp()){
+    return ! (timeManager_->canExtendTarget() && uct->isBestMoveUnstable() && 
+              timeManager_->extendTarget());
+  }
+  return false;
+}
+
+//--------------------------------------------------------------------- 
+
+int Engine::getPlayoutsLimit(int index) const
+{
+  return getBudgetShare(cfg.searchPlayouts(), index);
+}
+
+//--------------------------------------------------------------------- 
+
+int Engine::getNodesLimit(int index) const
+{
+  return getBudgetShare(cfg.searchNodes(), index);
+}
+
+//--------------------------------------------------------------------- 
+
+int Engine::getBudgetShare(int budget, int index) const
+{
+  if (budget <= 0){
+    return -1;
+  }
+  int threadsNum = searchPool_->getThreadsNum();
+  return budget / threadsNum + (index < budget % threadsNum ? 1 : 0);
+}
+
+//--------------------------------------------------------------------- 
+
+uint Engine::getSearchSeed(int index) const
+{
+  return deterministic_ ? cfg.searchSeed() + index : 0;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::instantReply(const Board* board)
+{
+  Move move;
+  string reason;
+  if (board->goalCheck(&move)){
+    reason = "goal";
+    winRatio_ = 1;
+  } 
+  else if (findOnlyMove(board, move)){
+    reason = "only move";
+    winRatio_ = 0.5;
+  }
+  //opponent threatens a capture and only one move prevents it
+  else if (board->trapCheck(board->getPlayerToMove()) && findOnlyMove(board, move, true)){
+    reason = "forced defence";
+    winRatio_ = 0.5;
+  }
+  else{
+    return false;
+  }
+
+  //clock runs for the time accounting
+  timeManager_->startClock(board->getPlayerToMove(), board->getMoveCount());
+  timeManager_->stopClock();
+
+  instantReplies_++;
+  logInfo("Instant reply (%s) - %d of %d moves answered instantly.", 
+          reason.c_str(), instantReplies_, movesAnswered_);
+
+  bestMove_ = board->moveToStringWithKills(move);
+  stringstream ss;
+  ss << "Instant reply (" << reason << "): " << endl
+     << "  " << instantReplies_ << " of " << movesAnswered_ << " moves answered instantly" << endl;
+  stats_ = ss.str();
+  additionalInfo_ = "";
+  playoutsNum_ = 0;
+  threadPlayouts_.clear();
+  return true;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::findOnlyMove(const Board* board, Move& move, bool defence) const
+{
+  set<u64> positions;
+  //position must change
+  positions.insert(board->getSignature());
+  set<pair<u64, int> > partial;
+  int defencePieces = defence ? 
+    bits::bitCount(board->getBitboard()[board->getPlayerToMove()][0]) : 0;
+  int found = 0;
+  if (! findOnlyMoveRec(board, Move(), defencePieces, positions, partial, found, move)){
+    return false;
+  }
+  return found == 1;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::findOnlyMoveRec(const Board* board, const Move& move, int defencePieces, 
+                             set<u64>& positions, set<pair<u64, int> >& partial, 
+                             int& found, Move& onlyMove) const
 {
-  return timeManager_->timeUp() || stopRequest_;
+  player_t player = board->getPlayerToMove();
+  StepArray steps;
+  int stepsNum = board->genStepsNoPass(player, steps);
+  stepsNum = board->filterRepetitions(steps, stepsNum);
+  if (board->canPass()){
+    steps[stepsNum++] = Step(STEP_PASS, player);
+  }
+
+  for (int i = 0; i < stepsNum; i++){
+    Board* next = new Board(*board);
+    Move nextMove = move;
+    nextMove.appendStep(steps[i]);
+    bool more = true;
+    if (next->makeStepTryCommit(steps[i])){
+      if (positions.insert(next->getSignature()).second){
+        //defence counts only positions where all pieces of the player are safe
+        if (! defencePieces || 
+            (bits::bitCount(next->getBitboard()[player][0]) == defencePieces && 
+             ! next->trapCheck(player))){
+          onlyMove = nextMove;
+          more = ++found < 2;
+        }
+        if (defencePieces && positions.size() > FORCED_DEFENCE_MAX_POSITIONS){
+          more = false;
+        }
+      }
+    }
+    else if (partial.insert(make_pair(next->getSignature(), next->getStepCount())).second){
+      more = findOnlyMoveRec(next, nextMove, defencePieces, positions, partial, found, onlyMove);
+    }
+    delete next;
+    if (! more){
+      return false;
+    }
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::bestMoveUnstable(const Uct* uct) const
+{
+  Tree* tree = uct->getTree();
+  Node* bestMoveNode = tree->findBestMoveNode(tree->root());
+  return bestMoveNode != tree->root() && tree->isBestMoveUnstable(bestMoveNode);
+}
+
+//--------------------------------------------------------------------- 
+
+bool Engine::bestMoveSettled(const Uct* uct) const
+{
+  if (timeManager_->isNoTimeLimit()){
+    return false;
+  }
+  double elapsed = timeManager_->secondsRunning();
+  double left = timeManager_->secondsLeft();
+  if (elapsed <= 0 || left <= 0){
+    return false;
+  }
+
+  Tree* tree = uct->getTree();
+  Node* bestMoveNode = tree->findBestMoveNode(tree->root());
+  if (bestMoveNode == tree->root()){
+    return false;
+  }
+  int lead = bestMoveNode->getVisits() - tree->findRivalVisits(bestMoveNode);
+
+  //rival might gain all the remaining playouts
+  double speed = (tree->root()->getVisits() - reusedVisits_) / elapsed;
+  return lead > speed * left * EARLY_STOP_MARGIN;
+}
+
+//--------------------------------------------------------------------- 
+
+void Engine::moveTreeSearch(const Board* board)
+{
+  //previous step tree doesn't fit
+  delete lastUct_;
+  delete lastBoard_;
+  delete ponderUct_;
+  delete ponderBoard_;
+  lastUct_ = NULL;
+  lastBoard_ = NULL;
+  ponderUct_ = NULL;
+  ponderBoard_ = NULL;
+  reusedVisits_ = 0;
+  earlyStop_ = false;
+
+  stopRequest_ = false;
+  timeManager_->startClock(board->getPlayerToMove(), board->getMoveCount());
+  uint seed = getSearchSeed(0);
+  if (seed){
+    glob.grand()->seed(seed);
+  }
+  MoveUct* uct = new MoveUct(board);
+  uct->searchTree(board, this);
+  timeManager_->stopClock();
+
+  uct->refineResults(board);
+  bestMove_ = uct->getBestMoveRepr();
+  stats_ = uct->getStats(timeManager_->secondsElapsed());
+  if (! timeManager_->isNoTimeLimit()){
+    stringstream ss;
+    ss << "  " << timeManager_->getTarget() << " seconds target, " 
+       << timeManager_->getLimit() << " seconds limit" << endl;
+    stats_ += ss.str();
+  }
+  additionalInfo_ = "";
+  winRatio_ = uct->getWinRatio();
+  playoutsNum_ = uct->getPlayoutsNum();
+  threadPlayouts_.clear();
+  threadPlayouts_.push_back(playoutsNum_);
+  delete uct;
+}
+
+//--------------------------------------------------------------------- 
+
+Board* Engine::predictReply(const Board* board, Move& move) const
+{
+  if (! lastUct_ || board->getStepCount() != 0){
+    return NULL;
+  }
+  const Node* node = lastUct_->getTree()->findPosition(lastBoard_, board, 
+                                                      TREE_REUSE_MAX_MOVES, TREE_REUSE_MIN_VISITS);
+  if (! node){
+    return NULL;
+  }
+  //reply is looked up in the last tree itself (subtree is not copied)
+  if (! lastUct_->getTree()->findMostVisitedMove(node, move)){
+    return NULL;
+  }
+  Board* next = new Board(*board);
+  StepList steps = move.getStepList();
+  bool committed = false;
+  for (StepListIter it = steps.begin(); it != steps.end() && ! committed; it++){
+    committed = next->makeStepTryCommit(*it);
+  }
+  //shorter move is finished by the pass (as when it is played) 
+  if (! committed && next->canPass()){
+    committed = next->makeStepTryCommit(Step(STEP_PASS, next->getPlayerToMove()));
+  }
+  //game must go on
+  if (! committed || next->getWinner() != NO_PLAYER){
+    delete next;
+    next = NULL;
+  }
+  return next;
+}
+
+//--------------------------------------------------------------------- 
+
+void Engine::resolvePonder(const Board* board)
+{
+  if (! ponderBoard_){
+    return;
+  }
+  if (ponderBoard_->getSignature() == board->getSignature() && 
+      ponderBoard_->getPlayerToMove() == board->getPlayerToMove() && 
+      ponderBoard_->getStepCount() == board->getStepCount()){
+    //search goes on in the pondered tree
+    ponderHits_++;
+    logInfo("Ponder hit - %d of %d expected replies played.", ponderHits_, pondered_);
+    delete lastUct_;
+    delete lastBoard_;
+    lastUct_ = ponderUct_;
+    lastBoard_ = ponderBoard_;
+  }
+  else{
+    delete ponderUct_;
+    delete ponderBoard_;
+  }
+  ponderUct_ = NULL;
+  ponderBoard_ = NULL;
 }
 
 //--------------------------------------------------------------------- 
@@ -248,37 +864,233 @@ void Engine::mockupSearchResults(const Board* board, Uct* ucts[], Uct* masterUct
   Uct * uct = ucts[0]; 
   if (masterUct) {
     uct = masterUct; 
+    //separate trees are merged in the thread order
+    if (deterministic_){
+      for (int i = 0; i < resultsNum; i++){
+        NodeStats stats;
+        ucts[i]->getTree()->collectFirstMoveStats(stats, 1);
+        uct->getTree()->mergeFirstMoveStats(stats);
+      }
+    }
     uct->updateStatistics(ucts, resultsNum);
   }
+  if (remoteWorkers_){
+    remoteWorkers_->mergeStatistics(uct, board);
+  }
 
   uct->refineResults(board);
   //get stuff from the search 
   bestMove_ = uct->getBestMoveRepr();
   stats_ = uct->getStats(timeManager_->secondsElapsed());
+  if (reusedVisits_){
+    stringstream ss;
+    ss << "  " << reusedVisits_ << " visits reused from the previous search" << endl;
+    stats_ += ss.str();
+  }
+  if (! timeManager_->isNoTimeLimit()){
+    stringstream ss;
+    ss << "  " << timeManager_->getTarget() << " seconds target, " 
+       << timeManager_->getLimit() << " seconds limit" << endl;
+    stats_ += ss.str();
+  }
+  if (deterministic_){
+    stringstream ss;
+    ss << "  deterministic search with seed " << cfg.searchSeed() << endl;
+    stats_ += ss.str();
+  }
+  if (timeManager_->timeSaved() > 0){
+    stringstream ss;
+    ss << "  " << timeManager_->timeSaved() << " seconds saved by the early stop" << endl;
+    stats_ += ss.str();
+  }
+  if (timeManager_->stopLatency() >= 0){
+    stringstream ss;
+    ss << "  " << timeManager_->stopLatency() * 1000 << " ms stop latency" << endl;
+    stats_ += ss.str();
+  }
   additionalInfo_ = uct->getAdditionalInfo();
   winRatio_ = uct->getWinRatio();
+  playoutsNum_ = uct->getPlayoutsNum();
+  threadPlayouts_.clear();
+  for (int i = 0; i < resultsNum; i++){
+    threadPlayouts_.push_back(ucts[i]->getPlayoutsNum());
+  }
 
 }
 
 //--------------------------------------------------------------------- 
 
-void * Engine::searchTreeWrapper(void * searchStartKit) 
+//---------------------------------------------------------------------
+//  section SearchPool
+//---------------------------------------------------------------------
+
+SearchPool::SearchPool()
 {
-  SearchStartKit * s = (SearchStartKit *) searchStartKit;
-  s->uct_->searchTree(s->board_, s->engineInstance_);
-  delete s;
-  return NULL;
+  assert(false);
 }
 
 //---------------------------------------------------------------------
-//  section TimeManager
+
+SearchPool::SearchPool(int threadsNum, int leafWorkersNum)
+{
+  threadsNum_ = min(threadsNum, MAX_THREADS);
+  leafWorkersNum_ = leafWorkersNum;
+  threadAffinity_ = cfg.threadAffinity();
+  board_ = NULL;
+  engine_ = NULL;
+  ucts_ = NULL;
+  masterUct_ = NULL;
+  sharedTT_ = NULL;
+  tacticsPool_ = NULL;
+  batch_ = 0;
+  running_ = 0;
+  started_ = 0;
+  quit_ = false;
+
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&workCond_, NULL);
+  pthread_cond_init(&doneCond_, NULL);
+
+  for (int t = 0; t < threadsNum_; t++){
+    int rc = pthread_create(&threads_[t], NULL, SearchPool::workerWrapper, (void*) this); 
+    if (rc) {
+      stringstream ss;
+      ss << "Fatal thread error no. " << rc << " when creating.";
+      logError(ss.str().c_str());
+      exit(1);
+    } 
+  }
+}
+
+//---------------------------------------------------------------------
+
+SearchPool::~SearchPool()
+{
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_broadcast(&workCond_);
+  pthread_mutex_unlock(&mutex_);
+
+  for (int t = 0; t < threadsNum_; t++){
+    int rc = pthread_join(threads_[t], NULL); 
+    if (rc) {
+      stringstream ss;
+      ss << "Fatal thread error no. " << rc << " when joining.";
+      logWarning(ss.str().c_str());
+      pthread_detach(threads_[t]);
+    }
+  }
+
+  pthread_cond_destroy(&doneCond_);
+  pthread_cond_destroy(&workCond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
 //---------------------------------------------------------------------
 
-SearchStartKit::SearchStartKit(const Board* board, Engine * engine, Uct* uct)
+void SearchPool::search(const Board* board, const Engine* engine, Uct* ucts[], Uct* masterUct, 
+                        SharedTT* sharedTT, TaskPool* tacticsPool)
 {
-  board_ = board;  
-  engineInstance_ = engine;
-  uct_ = uct;
+  pthread_mutex_lock(&mutex_);
+  assert(running_ == 0);
+  board_ = board;
+  engine_ = engine;
+  ucts_ = ucts;
+  masterUct_ = masterUct;
+  sharedTT_ = sharedTT;
+  tacticsPool_ = tacticsPool;
+  running_ = threadsNum_;
+  batch_++;
+  pthread_cond_broadcast(&workCond_);
+
+  while (running_ > 0){
+    pthread_cond_wait(&doneCond_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+//---------------------------------------------------------------------
+
+int SearchPool::getThreadsNum() const
+{
+  return threadsNum_;
+}
+
+//---------------------------------------------------------------------
+
+int SearchPool::getLeafWorkersNum() const
+{
+  return leafWorkersNum_;
+}
+
+//---------------------------------------------------------------------
+
+bool SearchPool::getThreadAffinity() const
+{
+  return threadAffinity_;
+}
+
+//---------------------------------------------------------------------
+
+void * SearchPool::workerWrapper(void * pool) 
+{
+  ((SearchPool*) pool)->workerLoop();
+  return NULL;
+}
+
+//---------------------------------------------------------------------
+
+void SearchPool::workerLoop()
+{
+  pthread_mutex_lock(&mutex_);
+  int index = started_++;
+  pthread_mutex_unlock(&mutex_);
+
+  //thread and its leaf workers occupy consecutive cores
+  int core = index * (leafWorkersNum_ + 1);
+  if (threadAffinity_ && ! pinThreadToCore(core)){
+    logWarning("Pinning search thread to core failed.");
+  }
+
+  PlayoutPool* playoutPool = NULL;
+  if (leafWorkersNum_ > 0){
+    playoutPool = new PlayoutPool(leafWorkersNum_, threadAffinity_ ? core + 1 : -1);
+  }
+
+  int batch = 0;
+  while (true){
+    pthread_mutex_lock(&mutex_);
+    while (! quit_ && batch == batch_){
+      pthread_cond_wait(&workCond_, &mutex_);
+    }
+    if (quit_){
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    batch = batch_;
+    pthread_mutex_unlock(&mutex_);
+
+    //uct might be given (reused tree)
+    if (! ucts_[index]){
+      ucts_[index] = new Uct(board_, masterUct_, sharedTT_);
+    }
+    //fixed seed and share of the playouts budget
+    uint seed = engine_->getSearchSeed(index);
+    if (seed){
+      glob.grand()->seed(seed);
+    }
+    ucts_[index]->setSearchLimits(engine_->getPlayoutsLimit(index), engine_->getNodesLimit(index));
+    ucts_[index]->searchTree(board_, engine_, playoutPool, tacticsPool_);
+
+    pthread_mutex_lock(&mutex_);
+    if (--running_ == 0){
+      pthread_cond_signal(&doneCond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  delete playoutPool;
+  glob.releaseThread();
 }
 
 //---------------------------------------------------------------------
@@ -11,9 +11,13 @@
 #include "timer.h"
 #include "board.h"
 #include "uct.h"
+#include "movetree.h"
 
 using std::vector;
 
+class SearchPool;
+class RemoteWorkers;
+
 
 //how much time engine has for "clock clicking"
 #define CLOCK_CLICK_RESERVE 0.1
@@ -22,6 +26,27 @@ using std::vector;
 #define TC_MOVE_DEFAULT (cfg.tcMoveDefault())
 //#define TC_MOVE_DEFAULT 1
 
+//reserve is spread over this many moves (less if the game ends sooner)
+#define RESERVE_SPREAD 10
+//expected number of remaining turns when the turns limit is unknown
+#define EXPECTED_TURNS_LEFT 40
+//search with unstable best move might run this many times its target
+#define TIME_EXTENSION_RATIO 2
+//shortest search (seconds) even if the time is almost over
+#define MIN_SEARCH_TIME 0.05
+
+//remaining playouts are overestimated by this ratio in the early stop
+#define EARLY_STOP_MARGIN 1.2
+
+//how many moves (of both players) tree reuse looks for the position
+#define TREE_REUSE_MAX_MOVES 2
+//minimal visits of the node to be reused
+#define TREE_REUSE_MIN_VISITS 10
+//seed of the deterministic search in the getMove mode (unless configured)
+#define DETERMINISTIC_SEED "1"
+//instant reply gives up the forced defence after this many positions 
+#define FORCED_DEFENCE_MAX_POSITIONS 2000
+
 //this defines size of following enum !!!
 #define TIME_CONTROLS_NUM 13
 
@@ -34,6 +59,10 @@ enum timeControl_e {TC_MOVE, TC_RESERVE, TC_PERCENT, TC_MAX, TC_TOTAL, TC_TURNS,
  * Time management.
  *
  * Accepts time settings and takes care of time management durint the game.
+ * Every move gets a target time and a hard limit computed from all 
+ * time controls. Search normally stops at the target, search with unstable 
+ * best move might be extended towards the limit. Reserves of players are 
+ * tracked (unless aei sends them).
  */
 class TimeManager
 {
@@ -42,22 +71,85 @@ class TimeManager
     
     /**
      * Starts clock for given move. 
+     *
+     * Computes the budget of the player. Without player only 
+     * the move time is used.
      */
-    void  startClock();
+    void  startClock(player_t player=NO_PLAYER, int moveCount=1);
 
     /**
      * Stops the clock. 
+     *
+     * Reserve of the player is updated with the time used.
      */
     void stopClock();
 
     /**
      * Checks the clock.
      *
+     * Reads the flag raised by the deadline timer (or the early stop) 
+     * - no clock query.
+     *
      * @return True if time is up, false otherwise.
      * TODO: Searcher might provide importance of time addition.
      */
     bool timeUp();
 
+    /**
+     * Ends the time for the move before the deadline.
+     *
+     * Time remaining to the target is recorded as saved. 
+     * Ignored in time unlimited search.
+     */
+    void stopEarly();
+
+    /**
+     * Whether the deadline at the target might be moved to the extended target.
+     *
+     * Also true when it was moved already and the flag of the target 
+     * deadline is still seen.
+     */
+    bool canExtendTarget();
+
+    /**
+     * Moves the deadline to the extended target (once per search).
+     *
+     * @return True if the search goes on.
+     */
+    bool extendTarget();
+
+    /**
+     * Seconds saved by the early stop in the last search (0 if none).
+     */
+    double timeSaved();
+
+    /**
+     * Target time of the last move (seconds).
+     */
+    double getTarget();
+
+    /**
+     * Hard limit of the last move (seconds).
+     */
+    double getLimit();
+
+    /**
+     * Seconds since startClock() (clock is still running).
+     */
+    double secondsRunning();
+
+    /**
+     * Seconds left to the target.
+     */
+    double secondsLeft();
+
+    /**
+     * Delay between the deadline and the stopClock() in seconds.
+     *
+     * @return Negative if the last search was not stopped by the deadline.
+     */
+    double stopLatency(); 
+
     /**
      *  Seconds elapsed since last startClock().
      */
@@ -80,6 +172,11 @@ class TimeManager
      * Sets time unlimited search. 
      */
     void setNoTimeLimit();
+
+    /**
+     * Whether search is time unlimited.
+     */
+    bool isNoTimeLimit();
     
     /**
      * Resets temporary settings like noTimeLimit.
@@ -87,9 +184,30 @@ class TimeManager
     void resetSettings();
 
   private:
+    /**
+     * Computes target, extended target and hard limit of the move.
+     */
+    void computeBudget(player_t player, int moveCount);
+
     Timer timer;
+    DeadlineTimer deadline_;
     float timeControls_[TIME_CONTROLS_NUM];
     bool noTimeLimit_;
+    double stopLatency_;
+    /**Flag raised by the early stop.*/
+    volatile bool early_;
+    /**Deadline was moved to the extended target.*/
+    volatile int extended_;
+    double timeSaved_;
+
+    /**Player to move in the actual search.*/
+    player_t player_;
+    /**Reserves of players (tracked or taken from aei).*/
+    double reserve_[2];
+    /**Budget of the move (seconds from startClock()).*/
+    double target_;
+    double extendedTarget_;
+    double limit_;
   
 };
 
@@ -161,22 +279,140 @@ class Engine
      */
     float getWinRatio() const;
 
+    /**
+     * Number of playouts in the last search.
+     */
+    int getPlayoutsNum() const;
+
+    /**
+     * Numbers of playouts of particular threads in the last search.
+     */
+    vector<int> getThreadPlayouts() const;
+
     /**
      * Check whether search should be stop.
      *
+     * @param uct Searching uct - at the target deadline search goes on 
+     *            (up to the extended target) if its best move is unstable.
+     * @param periodic Search is stopped as well when the best move is 
+     *                 settled (checked periodically - it is expensive).
      * @return True if Time is up or stop reaeust returned,
      *              otherwise false.
      */
-    bool checkSearchStop() const;
+    bool checkSearchStop(const Uct* uct=NULL, bool periodic=false) const;
+
+    /**
+     * Check whether the move tree search should be stopped.
+     *
+     * At the target deadline the search stops if the best move is stable.
+     */
+    bool checkSearchStop(const MoveUct* uct) const;
+
+    /**
+     * Share of the playouts budget (search_playouts) for the search thread.
+     *
+     * Remainder of the budget goes to the first threads.
+     * @return -1 if there is no budget.
+     */
+    int getPlayoutsLimit(int index) const;
+
+    /**
+     * Share of the nodes budget (search_nodes) for the search thread.
+     *
+     * Split as the playouts budget.
+     * @return -1 if there is no budget.
+     */
+    int getNodesLimit(int index) const;
+
+    /**
+     * Seed of the search thread in the deterministic search.
+     *
+     * @return 0 if the thread keeps its generator.
+     */
+    uint getSearchSeed(int index) const;
 
   private: 
 
+    /**
+     * Whether a rival of the best move with comparable visits has better value.
+     */
+    bool bestMoveUnstable(const Uct* uct) const;
+
+    /**
+     * Whether the best move can't be overtaken in the remaining time.
+     *
+     * Lead of the best move (in visits) is compared with visits the 
+     * rival could gain at the actual search speed.
+     */
+    bool bestMoveSettled(const Uct* uct) const;
+
     /**
      * Takes care of mocking the results from search.
      */
     void mockupSearchResults(const Board* board, Uct* uct[], Uct* masterUct, int resultsNum);
 
-  	static void * searchTreeWrapper(void * searchTreeInfo);		
+    /**
+     * Answers forced and winning moves without search.
+     *
+     * Immediate goal, the only legal move and the only move 
+     * saving a threatened piece are detected.
+     * @return True if the move was answered.
+     */
+    bool instantReply(const Board* board);
+
+    /**
+     * Searches the move tree (single thread) and sets the results.
+     */
+    void moveTreeSearch(const Board* board);
+
+    /**
+     * Expected reply of the opponent (to move on board).
+     *
+     * Taken from the tree of the last search (most visited move).
+     * @return Position after the reply or NULL if there is no move 
+     *         (or the game would be over).
+     */
+    Board* predictReply(const Board* board, Move& move) const;
+
+    /**
+     * Settles the last pondering before the next search.
+     *
+     * If the pondered position was reached its tree is taken for 
+     * the search, otherwise it is dropped (the last tree is reused).
+     */
+    void resolvePonder(const Board* board);
+
+    /**
+     * Finds the only legal move.
+     *
+     * Moves are generated until the second distinct position after 
+     * the move is found (cheap in common positions).
+     * @param defence Only positions where no piece of the player was lost 
+     *        and the opponent has no capture (trapCheck) count. 
+     *        Search gives up after FORCED_DEFENCE_MAX_POSITIONS.
+     * @return True if there is exactly one (counted) resulting position.
+     */
+    bool findOnlyMove(const Board* board, Move& move, bool defence=false) const;
+
+    /**
+     * Recursive step for findOnlyMove.
+     *
+     * @param move Steps made from the root to board.
+     * @param defencePieces Pieces of the player before the move when only 
+     *        defences count (0 otherwise).
+     * @param positions Signatures of distinct positions after the move.
+     * @param partial Positions (with steps made) inside the move - transpositions are cut.
+     * @param found Number of counted positions.
+     * @return False once more positions are found (or the search gives up).
+     */
+    bool findOnlyMoveRec(const Board* board, const Move& move, int defencePieces, 
+                         set<u64>& positions, set<pair<u64, int> >& partial, 
+                         int& found, Move& onlyMove) const;
+
+    /**
+     * Share of the budget for the search thread (-1 if there is no budget).
+     */
+    int getBudgetShare(int budget, int index) const;
 
     TimeManager* timeManager_;
 
@@ -184,28 +420,126 @@ class Engine
     string stats_;
     string additionalInfo_;
     float winRatio_;
+    int playoutsNum_;
+    vector<int> threadPlayouts_;
 
     /**Ponder mode flag.*/
     bool ponder_;
 
     /**Flag to stop search.*/
-    bool stopRequest_;
+    volatile bool stopRequest_;
+
+    /**Search threads (created with the first search).*/
+    SearchPool* searchPool_;
+
+    /**Worker processes for root parallelization (created with the first search).*/
+    RemoteWorkers* remoteWorkers_;
+
+    /**Transposition table shared by search threads (created with the first search).*/
+    SharedTT* sharedTT_;
+
+    /**Helper threads running tactics of expanded nodes (NULL when not used).*/
+    TaskPool* tacticsPool_;
+
+    /**Uct of the last search kept for the tree reuse (NULL if none).*/
+    Uct* lastUct_;
+    /**Board the last search was run for.*/
+    Board* lastBoard_;
+    /**Root visits taken over from the last search.*/
+    int reusedVisits_;
+
+    /**Tree of the pondering kept until the opponent moves (NULL if none).*/
+    Uct* ponderUct_;
+    /**Pondered position (after the expected reply).*/
+    Board* ponderBoard_;
+    /**Expected replies played by the opponent (and all pondered replies) for the log.*/
+    int ponderHits_;
+    int pondered_;
+
+    /**Search might stop once the best move is settled.*/
+    bool earlyStop_;
+
+    /**Search has a fixed budget and seed (threads search separate trees).*/
+    bool deterministic_;
+
+    /**Moves answered without search (and all moves) for the log.*/
+    int instantReplies_;
+    int movesAnswered_;
 };
 
 /**
- * Wrapper class for parallel search. 
+ * Persistent pool of search threads. 
+ *
+ * Threads (together with their per thread global structures) live 
+ * across searches and are woken up for every search. Each thread 
+ * owns a playout pool for leaf parallelization.
  */
-class SearchStartKit {
+class SearchPool {
   public:
-    SearchStartKit(const Board*, Engine*, Uct*);
+    /**
+     * Starts the search threads.
+     */
+    SearchPool(int threadsNum, int leafWorkersNum);
+
+    /**
+     * Stops and joins the search threads.
+     */
+    ~SearchPool();
+
+    /**
+     * Runs the search.
+     *
+     * Every thread creates its uct (memory is first touched by the 
+     * searching thread) unless it is given in ucts and runs searchTree of it. Blocks until all 
+     * threads are done.
+     *
+     * @param sharedTT Transposition table shared by threads (NULL means none).
+     * @param tacticsPool Helpers for tactics shared by threads (NULL means none).
+     */
+    void search(const Board* board, const Engine* engine, Uct* ucts[], Uct* masterUct, 
+                SharedTT* sharedTT=NULL, TaskPool* tacticsPool=NULL);
+
+    int getThreadsNum() const;
+    int getLeafWorkersNum() const;
+    bool getThreadAffinity() const;
   
   private:
+    SearchPool();
+
+    static void* workerWrapper(void* pool);
+
+    /**
+     * Search thread waiting for the search request.
+     */
+    void workerLoop();
+
+    int threadsNum_;
+    int leafWorkersNum_;
+    /**Threads are pinned to cores (when they start).*/
+    bool threadAffinity_;
+    pthread_t threads_[MAX_THREADS];
+
+    pthread_mutex_t mutex_;
+    /**Signals new search or quit.*/
+    pthread_cond_t workCond_;
+    /**Signals all threads are done.*/
+    pthread_cond_t doneCond_;
+
     /**Board to search on.*/
     const Board*  board_;
-    /**On which instance to start the search.*/
-    Engine* engineInstance_;
-    /**Uct instance to use for the search.*/
-    Uct*    uct_; 
-    friend class Engine;
+    /**Engine deciding the search stop.*/
+    const Engine* engine_;
+    /**Uct instances created by threads (one per thread).*/
+    Uct**   ucts_; 
+    Uct* masterUct_;
+    SharedTT* sharedTT_;
+    TaskPool* tacticsPool_;
+    /**Search counter - threads recognize new search.*/
+    int batch_;
+    /**Threads still searching.*/
+    int running_;
+    /**Index for the next starting thread.*/
+    int started_;
+    bool quit_;
 };
 
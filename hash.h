@@ -23,30 +23,85 @@ u64 getRandomU64();
 //corressponds to maximum depth of UCT tree (in levels ~ moves) 
 #define MAX_LEVELS 50
 
+//default number of slots in the hash table 
+#define HASH_TABLE_DEFAULT_SIZE (1 << 16)
+//maximal distance of item from its home slot 
+#define HASH_TABLE_MAX_PROBE 16
+
+/**
+ * Hash table with open addressing.
+ *
+ * Linear probing in preallocated array of slots (capacity is rounded up 
+ * to power of 2). Slot is occupied only if it carries actual generation, 
+ * therefore clear is O(1). Table with maximal capacity grows (doubles) 
+ * when it is half full. Probing is bounded by HASH_TABLE_MAX_PROBE - 
+ * when all slots in the probe window are occupied and the table can't grow, 
+ * item in the home slot is replaced (table behaves as a cache then).
+ */
 template<typename T> class HashTable
 {
   protected:
-    map <u64, T> table; 
+    struct Slot {
+      u64   key;
+      T     item;
+      uint  generation;
+    };
+
+    /**Slots array.*/
+    Slot* table_;
+    /**Number of slots - 1 (capacity is power of 2).*/
+    uint  mask_;
+    /**Actual generation - slots with other generation are empty.*/
+    uint  generation_;
+    /**Number of items in the table.*/
+    uint  size_;
+    /**Capacity up to which the table grows (0 - table doesn't grow).*/
+    uint  maxCapacity_;
 
   public:
     
-    HashTable()
+    /**
+     * Constructor.
+     *
+     * @param maxCapacity Table grows up to this capacity (0 - fixed capacity).
+     */
+    HashTable(uint capacity = HASH_TABLE_DEFAULT_SIZE, uint maxCapacity = 0)
+    {
+      uint c = 1;
+      while (c < capacity){
+        c <<= 1;
+      }
+      allocate(c);
+      maxCapacity_ = maxCapacity;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    ~HashTable()
     {
-      table.clear();
+      delete [] table_;
     }
 
     //--------------------------------------------------------------------- 
     
     void clear()
     {
-      table.clear();
+      generation_++;
+      //generation overflow - all slots must be emptied explicitly
+      if (generation_ == 0){
+        for (uint i = 0; i <= mask_; i++){
+          table_[i].generation = 0;
+        }
+        generation_ = 1;
+      }
+      size_ = 0;
     }
 
     //--------------------------------------------------------------------- 
     
     bool isEmpty()
     {
-      return table.empty();
+      return size_ == 0;
     }
 
     //--------------------------------------------------------------------- 
@@ -58,19 +113,37 @@ template<typename T> class HashTable
      */
     bool hasItem(u64 key)
     {
-      if (table.find(key) != table.end()) 
-        return true;
-      return false;
+      return find(key) != NULL;
     }
 
+    //--------------------------------------------------------------------- 
+
     /**
      * Inserts key->item into table.
      */
     void insertItem(u64 key, T item)
     {
-      table[key] = item;
+      //table grows before it gets crowded
+      if (2 * (size_ + 1) > mask_ + 1 && canGrow()){
+        grow();
+      }
+      if (place(key, item)){
+        return;
+      }
+      if (canGrow()){
+        grow();
+        if (place(key, item)){
+          return;
+        }
+      }
+      //probe window is full - replace
+      uint home = index(key);
+      table_[home].key = key;
+      table_[home].item = item;
     }
 
+    //--------------------------------------------------------------------- 
+
     /**
      * Loads key->item from table.
      *
@@ -79,18 +152,156 @@ template<typename T> class HashTable
      */
     bool loadItem(u64 key, T& item)
     {
-      if (hasItem(key)){
-        item = HashTable<T>::table[key];
+      Slot* slot = find(key);
+      if (slot){
+        item = slot->item;
         return true;
       }
       return false;
     }
+
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Removes key from the table (if present).
+     *
+     * Following items of the cluster are shifted back 
+     * so that probing doesn't need tombstones.
+     */
+    void removeItem(u64 key)
+    {
+      Slot* slot = find(key);
+      if (! slot){
+        return;
+      }
+      uint hole = slot - table_;
+      uint i = hole;
+      while (true){
+        i = (i + 1) & mask_;
+        Slot& next = table_[i];
+        if (next.generation != generation_){
+          break;
+        }
+        //item can be moved to the hole if its home is not in (hole, i]
+        if (((i - index(next.key)) & mask_) >= ((i - hole) & mask_)){
+          table_[hole] = next;
+          hole = i;
+        }
+      }
+      table_[hole].generation = generation_ - 1;
+      size_--;
+    }
+
+  protected:
+    /**
+     * Empty table of given capacity (power of 2).
+     */
+    void allocate(uint capacity)
+    {
+      table_ = new Slot[capacity];
+      mask_ = capacity - 1;
+      for (uint i = 0; i <= mask_; i++){
+        table_[i].generation = 0;
+      }
+      generation_ = 1;
+      size_ = 0;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    bool canGrow() const
+    {
+      return mask_ + 1 < maxCapacity_;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Doubles the capacity - items of actual generation are rehashed.
+     */
+    void grow()
+    {
+      Slot* old = table_;
+      uint oldMask = mask_;
+      uint oldGeneration = generation_;
+      allocate((mask_ + 1) * 2);
+      for (uint i = 0; i <= oldMask; i++){
+        if (old[i].generation == oldGeneration){
+          place(old[i].key, old[i].item);
+        }
+      }
+      delete [] old;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Puts key->item into the probe window.
+     *
+     * @return False if the probe window is full.
+     */
+    bool place(u64 key, T item)
+    {
+      uint home = index(key);
+      for (uint i = 0; i < HASH_TABLE_MAX_PROBE; i++){
+        Slot& slot = table_[(home + i) & mask_];
+        if (slot.generation != generation_){
+          slot.key = key;
+          slot.item = item;
+          slot.generation = generation_;
+          size_++;
+          return true;
+        }
+        if (slot.key == key){
+          slot.item = item;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Home slot of the key.
+     */
+    uint index(u64 key) const
+    {
+      return uint(key ^ (key >> 32)) & mask_;
+    }
+
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Finds slot with given key.
+     *
+     * @return Slot or NULL if key is not in the table.
+     */
+    Slot* find(u64 key) const
+    {
+      uint home = index(key);
+      for (uint i = 0; i < HASH_TABLE_MAX_PROBE; i++){
+        Slot* slot = &table_[(home + i) & mask_];
+        if (slot->generation != generation_){
+          return NULL;
+        }
+        if (slot->key == key){
+          return slot;
+        }
+      }
+      return NULL;
+    }
+
+  private:
+    HashTable(const HashTable&);
+    HashTable& operator=(const HashTable&);
 };
 
 template<typename T> class HashTableBoard : public HashTable<T>
 {
   public:
-    HashTableBoard(): HashTable<T>()
+    HashTableBoard(uint capacity = HASH_TABLE_DEFAULT_SIZE, uint maxCapacity = 0): 
+      HashTable<T>(capacity, maxCapacity)
     {
       playerSignature_[0] = getRandomU64();
       playerSignature_[1] = getRandomU64(); 
@@ -140,12 +351,28 @@ template<typename T> class HashTableBoard : public HashTable<T>
       return HashTable<T>::loadItem(key, item);
     }
 
+    //--------------------------------------------------------------------- 
+
+    /**
+     * Wrapper around HashTable::removeItem.
+     */
+    void removeItem(u64 key, uint playerIndex, uint level=0)
+    {
+      assert(playerIndex == 0 || playerIndex == 1);
+      key ^= playerSignature_[playerIndex];
+      key ^= levelSignature_[level % MAX_LEVELS]; 
+      HashTable<T>::removeItem(key);
+    }
+
   protected:
     u64 playerSignature_[2];
     u64 levelSignature_[MAX_LEVELS];
 
 };
 
+//positions in one game fit in easily
+#define THIRD_REP_SIZE (1 << 12)
+
 /**
  * Checking third repetitions.
  * 
@@ -154,7 +381,7 @@ template<typename T> class HashTableBoard : public HashTable<T>
 class ThirdRep: public HashTableBoard<int>
 {
 	public:
-    ThirdRep(): HashTableBoard<int>()
+    ThirdRep(): HashTableBoard<int>(THIRD_REP_SIZE)
     {
       playerSignature_[0] = getRandomU64();
       playerSignature_[1] = getRandomU64(); 
@@ -182,11 +409,7 @@ extern ThirdRep thirdRep;
 
 //forward declaration
 class Node; 
-
-typedef list<Node*> NodeList;
-
-//forward declaration
-class ttItem;
+class TTitem;
 
 //typedef map<u64, Node*> TTpair;
 //typedef map<u64, Node*> TTmap;
@@ -196,8 +419,12 @@ class ttItem;
  *
  * Implements mapping: 
  * "key(position signature, player, move - tree depth ) ---> 
- *    pointer to the node in the tree"
+ *    position item (statistics and children) in the tree"
  */
-typedef HashTableBoard<NodeList *> TT;
+typedef HashTableBoard<TTitem *> TT;
+
+//initial and maximal number of slots in uct transposition table
+#define TT_INIT_SIZE (1 << 10)
+#define TT_SIZE (1 << 19)
 
 typedef HashTable<float> EvalTT;
@@ -4,6 +4,7 @@
 #include "engine.h"
 #include "benchmark.h"
 #include "aei.h"
+#include "remote.h"
  
 /*! \mainpage Akimot reference manual
  *
@@ -45,9 +46,27 @@ int main(int argc, char *argv[])
     //exit(1);
   }
 
+  //root parallelization worker
+  if (options.workerAddress() != ""){
+    //workers never spawn workers
+    cfg.setItem("root_workers_num", "0");
+    RemoteWorker worker(options.workerAddress());
+    worker.run();
+    return 0;
+  }
+
   //getMove protocol
   if (options.getMoveMode()){
 
+    //fixed budget and seed (seed from the configuration is kept)
+    if (options.playouts() > 0){
+      stringstream ss;
+      ss << options.playouts();
+      cfg.setItem("search_playouts", ss.str());
+      if (! cfg.searchSeed()){
+        cfg.setItem("search_seed", DETERMINISTIC_SEED);
+      }
+    }
 
     Board board;
     Engine* engine = new Engine();
@@ -66,13 +85,12 @@ int main(int argc, char *argv[])
       logDebug("Loading from position %s.\n", options.fnPosition().c_str());
       if (! board.initFromPosition(options.fnPosition().c_str())){
         //logError("Couldn't read position from file %s.\n", options.fnPosition().c_str());
-      }
-
-      logDebug("Loading from record %s.\n", options.fnRecord().c_str());
-      //try to read as if it's a record
-      if (! board.initFromRecord(options.fnPosition().c_str(), true)){
-        logError("Couldn't read position or record from file %s.\n", options.fnPosition().c_str());
-        return 1;
+        logDebug("Loading from record %s.\n", options.fnRecord().c_str());
+        //try to read as if it's a record
+        if (! board.initFromRecord(options.fnPosition().c_str(), true)){
+          logError("Couldn't read position or record from file %s.\n", options.fnPosition().c_str());
+          return 1;
+        }
       }
     } 
 
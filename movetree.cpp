@@ -0,0 +1,497 @@
+#include "engine.h"
+#include "movetree.h"
+#include "uct.h"
+
+//---------------------------------------------------------------------
+//  section MoveNode
+//---------------------------------------------------------------------
+
+MoveNode::MoveNode()
+{
+  assert(false);
+}
+
+//---------------------------------------------------------------------
+
+MoveNode::MoveNode(player_t player, const Step* steps, int stepsNum, u64 signature)
+{
+  assert(stepsNum <= STEPS_IN_MOVE);
+  for (int i = 0; i < stepsNum; i++){
+    steps_[i] = steps[i];
+  }
+  stepsNum_ = stepsNum;
+  player_ = player;
+  signature_ = signature;
+  value_ = 0;
+  visits_ = 0;
+  childrenNum_ = 0;
+  exhausted_ = false;
+  winner_ = NO_PLAYER;
+  father_ = NULL;
+  firstChild_ = NULL;
+  sibling_ = NULL;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode::~MoveNode()
+{
+  MoveNode* act = firstChild_;
+  while (act){
+    MoveNode* next = act->sibling_;
+    delete act;
+    act = next;
+  }
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveNode::findUctChild() const
+{
+  assert(firstChild_);
+  float exploreCoeff = cfg.exploreRate() * log(float(max(visits_, 1)));
+  MoveNode* best = firstChild_;
+  float bestUrgency = INT_MIN;
+
+  for (MoveNode* act = firstChild_; act; act = act->sibling_){
+    //fresh child goes first
+    if (! act->visits_){
+      return act;
+    }
+    float value = act->player_ == GOLD ? act->value_ : - act->value_;
+    float urgency = value + sqrt(exploreCoeff / act->visits_);
+    if (urgency > bestUrgency){
+      best = act;
+      bestUrgency = urgency;
+    }
+  }
+  return best;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveNode::findMostVisitedChild() const
+{
+  MoveNode* best = firstChild_;
+  for (MoveNode* act = firstChild_; act; act = act->sibling_){
+    //winning move is sure
+    if (act->winner_ == act->player_){
+      return act;
+    }
+    if (act->visits_ > best->visits_){
+      best = act;
+    }
+  }
+  return best;
+}
+
+//---------------------------------------------------------------------
+
+bool MoveNode::canWiden() const
+{
+  return ! exhausted_ &&
+         childrenNum_ < MOVE_TREE_WIDEN_BASE + MOVE_TREE_WIDEN_COEF * sqrt(float(visits_));
+}
+
+//---------------------------------------------------------------------
+
+bool MoveNode::hasChild(u64 signature) const
+{
+  for (MoveNode* act = firstChild_; act; act = act->sibling_){
+    if (act->signature_ == signature){
+      return true;
+    }
+  }
+  return false;
+}
+
+//---------------------------------------------------------------------
+
+void MoveNode::addChild(MoveNode* child)
+{
+  child->father_ = this;
+  child->sibling_ = firstChild_;
+  firstChild_ = child;
+  childrenNum_++;
+}
+
+//---------------------------------------------------------------------
+
+void MoveNode::update(float sample)
+{
+  value_ = (value_ * visits_ + sample) / (visits_ + 1);
+  visits_++;
+}
+
+//---------------------------------------------------------------------
+
+void MoveNode::makeMove(Board* board) const
+{
+  assert(board->getPlayerToMove() == player_);
+  for (int i = 0; i < stepsNum_; i++){
+    if (board->makeStepTryCommit(steps_[i])){
+      return;
+    }
+  }
+  //move shorter than 4 steps without pass (goal)
+  board->commit();
+}
+
+//---------------------------------------------------------------------
+
+Move MoveNode::getMove() const
+{
+  Move move;
+  for (int i = 0; i < stepsNum_; i++){
+    move.appendStep(steps_[i]);
+  }
+  return move;
+}
+
+//---------------------------------------------------------------------
+
+void MoveNode::setExhausted()
+{
+  exhausted_ = true;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveNode::getFather() const
+{
+  return father_;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveNode::getFirstChild() const
+{
+  return firstChild_;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveNode::getSibling() const
+{
+  return sibling_;
+}
+
+//---------------------------------------------------------------------
+
+player_t MoveNode::getPlayer() const
+{
+  return player_;
+}
+
+//---------------------------------------------------------------------
+
+int MoveNode::getVisits() const
+{
+  return visits_;
+}
+
+//---------------------------------------------------------------------
+
+float MoveNode::getValue() const
+{
+  return value_;
+}
+
+//---------------------------------------------------------------------
+
+int MoveNode::getChildrenNum() const
+{
+  return childrenNum_;
+}
+
+//---------------------------------------------------------------------
+
+player_t MoveNode::getWinner() const
+{
+  return winner_;
+}
+
+//---------------------------------------------------------------------
+
+void MoveNode::setWinner(player_t winner)
+{
+  winner_ = winner;
+}
+
+//---------------------------------------------------------------------
+//  section MoveUct
+//---------------------------------------------------------------------
+
+MoveUct::MoveUct()
+{
+  assert(false);
+}
+
+//---------------------------------------------------------------------
+
+MoveUct::MoveUct(const Board* board)
+{
+  //root represents the opponent's (already played) move
+  root_ = new MoveNode(OPP(board->getPlayerToMove()), NULL, 0, board->getSignature());
+  eval_ = new Eval(board);
+  playouts_ = 0;
+  nodesNum_ = 1;
+  maxDepth_ = 0;
+  depthSum_ = 0;
+  bestMoveNode_ = NULL;
+  bestMoveRepr_ = "";
+}
+
+//---------------------------------------------------------------------
+
+MoveUct::~MoveUct()
+{
+  delete eval_;
+  delete root_;
+}
+
+//---------------------------------------------------------------------
+
+void MoveUct::searchTree(const Board* board, const Engine* engine)
+{
+  while (! engine->checkSearchStop(this) &&
+         ! IS_PLAYER(root_->getWinner()) && 
+         ! (cfg.searchPlayouts() > 0 && playouts_ >= cfg.searchPlayouts()) && 
+         ! (cfg.searchNodes() > 0 && nodesNum_ >= cfg.searchNodes())){
+    doPlayout(board);
+    //goal move is the only child of the root
+    MoveNode* first = root_->getFirstChild();
+    if (first && first->getWinner() == first->getPlayer()){
+      break;
+    }
+  }
+}
+
+//---------------------------------------------------------------------
+
+void MoveUct::refineResults(const Board* board)
+{
+  bestMoveNode_ = root_->findMostVisitedChild();
+  bestMoveRepr_ = bestMoveNode_ ? board->moveToStringWithKills(bestMoveNode_->getMove()) : "";
+}
+
+//---------------------------------------------------------------------
+
+void MoveUct::doPlayout(const Board* board)
+{
+  Board* playBoard = new Board(*board);
+  MoveNode* node = root_;
+  int depth = 0;
+  float sample;
+
+  while (true){
+    //game ended with the move
+    if (IS_PLAYER(node->getWinner())){
+      sample = WINNER_TO_VALUE(node->getWinner());
+      break;
+    }
+
+    if (node->getVisits() < MOVE_TREE_MATURE || depth >= MOVE_TREE_MAX_DEPTH){
+      int base = 1 + (glob.grand()->getOne() % cfg.playoutLen());
+      int playoutLen = base + (playBoard->getPlayerToMove() == board->getPlayerToMove() ? 1 : 0);
+      AdvisorPlayout playoutManager(playBoard, MAX_PLAYOUT_LENGTH, playoutLen, NULL);
+      playoutManager.doPlayout();
+      sample = decidePlayoutWinner(playBoard);
+      break;
+    }
+
+    MoveNode* child = node->canWiden() ? widen(node, playBoard) : NULL;
+    if (! child){
+      //imobilization is a loss for player to move
+      if (! node->getFirstChild()){
+        node->setWinner(node->getPlayer());
+        continue;
+      }
+      child = node->findUctChild();
+    }
+    node = child;
+    depth++;
+    if (! IS_PLAYER(node->getWinner())){
+      node->makeMove(playBoard);
+    }
+  }
+
+  for (; node; node = node->getFather()){
+    node->update(sample);
+  }
+  playouts_++;
+  depthSum_ += depth;
+  maxDepth_ = max(maxDepth_, depth);
+  delete playBoard;
+}
+
+//---------------------------------------------------------------------
+
+MoveNode* MoveUct::widen(MoveNode* node, const Board* board)
+{
+  player_t player = board->getPlayerToMove();
+  Step steps[STEPS_IN_MOVE];
+  int stepsNum = 0;
+  MoveNode* child = NULL;
+
+  //winning move goes first
+  Move move;
+  if (! node->getFirstChild() && board->goalCheck(&move)){
+    StepList stepList = move.getStepList();
+    for (StepListIter it = stepList.begin(); it != stepList.end() && stepsNum < STEPS_IN_MOVE; it++){
+      steps[stepsNum++] = *it;
+    }
+    child = new MoveNode(player, steps, stepsNum, 0);
+    child->setWinner(player);
+    node->addChild(child);
+    //nothing beats the goal
+    node->setExhausted();
+    nodesNum_++;
+    return child;
+  }
+
+  for (int i = 0; i < MOVE_TREE_SAMPLE_TRIES; i++){
+    Board* moveBoard = new Board(*board);
+    if (sampleMove(moveBoard, steps, stepsNum) &&
+        moveBoard->getSignature() != board->getSignature() &&
+        ! node->hasChild(moveBoard->getSignature())){
+      child = new MoveNode(player, steps, stepsNum, moveBoard->getSignature());
+      child->setWinner(moveBoard->getWinner());
+      node->addChild(child);
+      nodesNum_++;
+    }
+    delete moveBoard;
+    if (child){
+      return child;
+    }
+  }
+
+  //new moves are too rare
+  node->setExhausted();
+  return NULL;
+}
+
+//---------------------------------------------------------------------
+
+bool MoveUct::sampleMove(Board* board, Step* steps, int& stepsNum) const
+{
+  stepsNum = 0;
+  StepArray stepArray;
+  while (true){
+    uint len = board->genStepsNoPass(board->getPlayerToMove(), stepArray);
+    len = board->filterRepetitions(stepArray, len);
+    if (board->canPass()){
+      stepArray[len++] = Step(STEP_PASS, board->getPlayerToMove());
+    }
+    if (! len){
+      return false;
+    }
+
+    uint index = glob.grand()->getOne() % len;
+    //the best of random half by the step heuristics
+    if (cfg.knowledgeInTree()){
+      HeurArray heurs;
+      board->getHeuristics(stepArray, len, heurs);
+      float bestHeur = INT_MIN;
+      for (uint i = 0; i < len; i++){
+        if (glob.grand()->get01() <= 0.5){
+          continue;
+        }
+        if (heurs[i] > bestHeur){
+          bestHeur = heurs[i];
+          index = i;
+        }
+      }
+    }
+
+    steps[stepsNum++] = stepArray[index];
+    if (board->makeStepTryCommit(stepArray[index])){
+      return true;
+    }
+  }
+}
+
+//---------------------------------------------------------------------
+
+float MoveUct::decidePlayoutWinner(const Board* playBoard) const
+{
+  if IS_PLAYER(playBoard->getWinner()){
+    return WINNER_TO_VALUE(playBoard->getWinner());
+  }
+
+  double evalGold = eval_->evaluateInPercent(playBoard);
+  if (cfg.exactPlayoutValue()){
+    return 2 * (evalGold - 0.5);
+  }
+  double r = (double)glob.grand()->getOne()/((double)(RAND_MAX) + (double)(1));
+  return r < evalGold ? 1 : -1;
+}
+
+//---------------------------------------------------------------------
+
+string MoveUct::getStats(float seconds) const
+{
+  assert(seconds > 0);
+  stringstream ss;
+
+  ss  << "Move tree UCT: " << endl
+      << "  " << playouts_ << " playouts" << endl
+      << "  " << seconds << " seconds" << endl
+      << "  " << int(playouts_ / seconds) << " playouts per second" << endl
+      << "  " << nodesNum_ << " nodes in the tree" << endl
+      << "  " << nodesNum_ * sizeof(MoveNode) / 1024 << " kB of nodes" << endl
+      << "  " << root_->getChildrenNum() << " moves in the root" << endl
+      << "  " << (playouts_ ? depthSum_/float(playouts_) : 0) << " average depth in moves" << endl
+      << "  " << maxDepth_ << " maximal depth in moves" << endl
+      << "  " << "best move: " << getBestMoveRepr() << endl
+      << "  " << "best move visits: " << (bestMoveNode_ ? bestMoveNode_->getVisits() : 0) << endl
+      << "  " << "win condidence: " << getWinRatio() << endl
+    ;
+  return ss.str();
+}
+
+//---------------------------------------------------------------------
+
+string MoveUct::getBestMoveRepr() const
+{
+  return bestMoveRepr_;
+}
+
+//---------------------------------------------------------------------
+
+float MoveUct::getWinRatio() const
+{
+  if (! bestMoveNode_){
+    return 0.5;
+  }
+  float ratio = (bestMoveNode_->getValue() + 1) / 2;
+  if (IS_PLAYER(bestMoveNode_->getWinner())){
+    ratio = bestMoveNode_->getWinner() == GOLD ? 1 : 0;
+  }
+  return bestMoveNode_->getPlayer() == GOLD ? ratio : 1 - ratio;
+}
+
+//---------------------------------------------------------------------
+
+int MoveUct::getPlayoutsNum() const
+{
+  return playouts_;
+}
+
+//---------------------------------------------------------------------
+
+bool MoveUct::isBestMoveUnstable() const
+{
+  MoveNode* best = root_->findMostVisitedChild();
+  if (! best || IS_PLAYER(best->getWinner())){
+    return false;
+  }
+  float sign = best->getPlayer() == GOLD ? 1 : -1;
+  for (MoveNode* act = root_->getFirstChild(); act; act = act->getSibling()){
+    if (act != best && act->getVisits() >= UNSTABLE_VISITS_RATIO * best->getVisits() &&
+        sign * act->getValue() > sign * best->getValue()){
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file movetree.h
+ *
+ * @brief Search tree with full moves as edges.
+ * @full Alternative to the step tree (uct.h). Every edge is a distinct move
+ * (distinct resulting position) so one level is one move and transpositions
+ * inside the move are merged by construction. There are thousands of moves
+ * in a typical position - children are sampled lazily (progressive widening).
+ */
+
+#pragma once
+
+#include "utils.h"
+#include "board.h"
+#include "eval.h"
+
+class Engine;
+
+//node might have MOVE_TREE_WIDEN_BASE + MOVE_TREE_WIDEN_COEF * sqrt(visits) children
+#define MOVE_TREE_WIDEN_BASE 1
+#define MOVE_TREE_WIDEN_COEF 2
+//attempts to sample a move which is not among the children yet
+#define MOVE_TREE_SAMPLE_TRIES 10
+//node is widened after this number of visits (playout is run before)
+#define MOVE_TREE_MATURE 1
+//maximal depth in moves
+#define MOVE_TREE_MAX_DEPTH 30
+
+/**
+ * Node of the move tree.
+ *
+ * Edge from the father is a full move.
+ */
+class MoveNode
+{
+  public:
+    /**
+     * @param steps Steps of the move (pass included).
+     * @param signature Signature of the position after the move.
+     */
+    MoveNode(player_t player, const Step* steps, int stepsNum, u64 signature);
+
+    /**
+     * Deletes children recursively.
+     */
+    ~MoveNode();
+
+    /**
+     * Finds child with highest UCB1 value.
+     */
+    MoveNode* findUctChild() const;
+
+    /**
+     * Finds child with most visits.
+     */
+    MoveNode* findMostVisitedChild() const;
+
+    /**
+     * Whether the node might get a new child.
+     */
+    bool canWiden() const;
+
+    /**
+     * Whether child with the position (after move) exists.
+     */
+    bool hasChild(u64 signature) const;
+
+    void addChild(MoveNode* child);
+
+    /**
+     * Update after playout.
+     */
+    void update(float sample);
+
+    /**
+     * Makes the move on the board (and commits it).
+     */
+    void makeMove(Board* board) const;
+
+    /**
+     * Move leading to the node.
+     */
+    Move getMove() const;
+
+    /**
+     * Sampling found no new move - node is not widened anymore.
+     */
+    void setExhausted();
+
+    MoveNode* getFather() const;
+    MoveNode* getFirstChild() const;
+    MoveNode* getSibling() const;
+    player_t getPlayer() const;
+    int getVisits() const;
+    float getValue() const;
+    int getChildrenNum() const;
+    /**Winner after the move (NO_PLAYER if game goes on).*/
+    player_t getWinner() const;
+    void setWinner(player_t winner);
+
+  private:
+    MoveNode();
+
+    Step steps_[STEPS_IN_MOVE];
+    int stepsNum_;
+    /**Player who made the move.*/
+    player_t player_;
+    u64 signature_;
+    /**Value in [-1, 1] (gold's point of view).*/
+    float value_;
+    int visits_;
+    int childrenNum_;
+    bool exhausted_;
+    player_t winner_;
+
+    MoveNode* father_;
+    MoveNode* firstChild_;
+    MoveNode* sibling_;
+};
+
+/**
+ * Uct search in the move tree.
+ *
+ * Single threaded counterpart of Uct.
+ */
+class MoveUct
+{
+  public:
+    MoveUct(const Board* board);
+    ~MoveUct();
+
+    /**
+     * Runs the doPlayout loop until the engine stops the search.
+     */
+    void searchTree(const Board* board, const Engine* engine);
+
+    /**
+     * Results refinement after search.
+     */
+    void refineResults(const Board* board);
+
+    /**
+     * Search statistics.
+     */
+    string getStats(float seconds) const;
+
+    string getBestMoveRepr() const;
+
+    /**
+     * Win ratio of the best move for the player to move.
+     */
+    float getWinRatio() const;
+
+    int getPlayoutsNum() const;
+
+    /**
+     * Whether a rival of the most visited move with comparable visits
+     * has better value.
+     */
+    bool isBestMoveUnstable() const;
+
+  private:
+    MoveUct();
+
+    /**
+     * One descend, playout and update.
+     */
+    void doPlayout(const Board* board);
+
+    /**
+     * Adds a new child (move is sampled).
+     *
+     * @return New child or NULL if no new move was found.
+     */
+    MoveNode* widen(MoveNode* node, const Board* board);
+
+    /**
+     * Samples a legal move step by step.
+     *
+     * Steps are chosen by the step heuristics (from a random half
+     * of legal steps), repetitions are filtered.
+     * @return False if the move couldn't be finished.
+     */
+    bool sampleMove(Board* board, Step* steps, int& stepsNum) const;
+
+    float decidePlayoutWinner(const Board* board) const;
+
+    MoveNode* root_;
+    Eval* eval_;
+    int playouts_;
+    int nodesNum_;
+    /**Deepest descend in moves.*/
+    int maxDepth_;
+    long depthSum_;
+
+    MoveNode* bestMoveNode_;
+    string bestMoveRepr_;
+};
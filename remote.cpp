@@ -0,0 +1,491 @@
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "remote.h"
+#include "config.h"
+#include "timer.h"
+
+//---------------------------------------------------------------------
+//  section communication
+//---------------------------------------------------------------------
+
+bool remoteSend(int fd, remoteMsg_e type, const void* data, int size)
+{
+  RemoteHeader header;
+  header.type = type;
+  header.size = size;
+
+  const char* parts[2] = {(const char*) &header, (const char*) data};
+  int sizes[2] = {int(sizeof(header)), size};
+  for (int p = 0; p < 2; p++){
+    int sent = 0;
+    while (sent < sizes[p]){
+      int rc = send(fd, parts[p] + sent, sizes[p] - sent, MSG_NOSIGNAL);
+      if (rc < 0 && errno == EINTR){
+        continue;
+      }
+      if (rc <= 0){
+        return false;
+      }
+      sent += rc;
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------
+
+bool remoteRecv(int fd, void* data, int size)
+{
+  int received = 0;
+  while (received < size){
+    int rc = recv(fd, (char*) data + received, size - received, 0);
+    if (rc < 0 && errno == EINTR){
+      continue;
+    }
+    if (rc <= 0){
+      return false;
+    }
+    received += rc;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------
+//  section RemoteWorkers
+//---------------------------------------------------------------------
+
+RemoteWorkers::RemoteWorkers()
+{
+  assert(false);
+}
+
+//---------------------------------------------------------------------
+
+RemoteWorkers::RemoteWorkers(int workersNum)
+{
+  workersNum_ = 0;
+  requestedNum_ = workersNum;
+  pidsNum_ = 0;
+  search_ = 0;
+  quit_ = false;
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&finalCond_, &attr);
+  pthread_condattr_destroy(&attr);
+
+  workersNum = min(workersNum, MAX_REMOTE_WORKERS);
+  connectWorkers(workersNum);
+  if (workersNum_ < workersNum){
+    logWarning("Only %d of %d remote workers connected.", workersNum_, workersNum);
+  }
+
+  pthread_create(&collector_, NULL, RemoteWorkers::collectorWrapper, (void*) this);
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::connectWorkers(int workersNum)
+{
+  //workers connect to the loopback (port is chosen by the system)
+  int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t addrLen = sizeof(addr);
+  if (listenFd < 0 ||
+      bind(listenFd, (sockaddr*) &addr, sizeof(addr)) < 0 ||
+      listen(listenFd, workersNum) < 0 ||
+      getsockname(listenFd, (sockaddr*) &addr, &addrLen) < 0){
+    logError("Couldn't open socket for remote workers.");
+    if (listenFd >= 0){
+      close(listenFd);
+    }
+    return;
+  }
+  fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+
+  for (int i = 0; i < workersNum; i++){
+    if (spawnWorker(ntohs(addr.sin_port))){
+      pidsNum_++;
+    }
+  }
+
+  Timer timer(REMOTE_CONNECT_TIME);
+  timer.start();
+  while (workersNum_ < pidsNum_ && ! timer.timeUp()){
+    pollfd pfd;
+    pfd.fd = listenFd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100) <= 0){
+      continue;
+    }
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0){
+      continue;
+    }
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    final_[workersNum_] = true;
+    playouts_[workersNum_] = 0;
+    fds_[workersNum_++] = fd;
+  }
+  close(listenFd);
+}
+
+//---------------------------------------------------------------------
+
+RemoteWorkers::~RemoteWorkers()
+{
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(collector_, NULL);
+
+  sendAll(RM_QUIT, NULL, 0);
+  for (int i = 0; i < workersNum_; i++){
+    close(fds_[i]);
+  }
+  for (int i = 0; i < pidsNum_; i++){
+    waitpid(pids_[i], NULL, 0);
+  }
+
+  pthread_cond_destroy(&finalCond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::startSearch(const Board* board)
+{
+  pthread_mutex_lock(&mutex_);
+  search_++;
+  for (int i = 0; i < workersNum_; i++){
+    stats_[i].clear();
+    playouts_[i] = 0;
+    final_[i] = false;
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  //boards are plain data - same binary on the other side
+  sendAll(RM_SEARCH, board, sizeof(Board));
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::stopSearch()
+{
+  sendAll(RM_STOP, NULL, 0);
+
+  timespec deadline = Timer::toTimespec(Timer::now() + REMOTE_WAIT_TIME);
+
+  pthread_mutex_lock(&mutex_);
+  while (true){
+    bool allFinal = true;
+    for (int i = 0; i < workersNum_; i++){
+      allFinal = allFinal && final_[i];
+    }
+    if (allFinal || pthread_cond_timedwait(&finalCond_, &mutex_, &deadline) == ETIMEDOUT){
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::mergeStatistics(Uct* uct, const Board* board)
+{
+  pthread_mutex_lock(&mutex_);
+  for (int i = 0; i < workersNum_; i++){
+    uct->mergeRemoteStatistics(stats_[i], playouts_[i], board);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+//---------------------------------------------------------------------
+
+int RemoteWorkers::getWorkersNum() const
+{
+  return workersNum_;
+}
+
+//---------------------------------------------------------------------
+
+int RemoteWorkers::getRequestedNum() const
+{
+  return requestedNum_;
+}
+
+//---------------------------------------------------------------------
+
+bool RemoteWorkers::spawnWorker(int port)
+{
+  stringstream ss;
+  ss << "127.0.0.1:" << port;
+  string address = ss.str();
+  string fnCfg = options.fnCfg() != "" ? options.fnCfg() : string(DEFAULT_CFG);
+
+  pid_t pid = fork();
+  if (pid < 0){
+    logWarning("Couldn't fork remote worker.");
+    return false;
+  }
+  if (pid == 0){
+    execl("/proc/self/exe", "akimot", "-c", fnCfg.c_str(), "-w", address.c_str(), (char*) NULL);
+    _exit(1);
+  }
+  pids_[pidsNum_] = pid;
+  return true;
+}
+
+//---------------------------------------------------------------------
+
+void* RemoteWorkers::collectorWrapper(void* instance)
+{
+  ((RemoteWorkers*) instance)->collectorLoop();
+  return NULL;
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::collectorLoop()
+{
+  pollfd pfds[MAX_REMOTE_WORKERS];
+  bool alive[MAX_REMOTE_WORKERS];
+  for (int i = 0; i < workersNum_; i++){
+    alive[i] = true;
+  }
+
+  while (true){
+    pthread_mutex_lock(&mutex_);
+    bool quit = quit_;
+    pthread_mutex_unlock(&mutex_);
+    if (quit){
+      break;
+    }
+
+    for (int i = 0; i < workersNum_; i++){
+      pfds[i].fd = alive[i] ? fds_[i] : -1;
+      pfds[i].events = POLLIN;
+      pfds[i].revents = 0;
+    }
+    if (poll(pfds, workersNum_, 100) <= 0){
+      continue;
+    }
+
+    for (int i = 0; i < workersNum_; i++){
+      if (! (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))){
+        continue;
+      }
+      RemoteHeader header;
+      RemoteStatsHeader statsHeader;
+      NodeStats stats;
+      bool ok = remoteRecv(fds_[i], &header, sizeof(header)) &&
+                header.type == RM_STATS &&
+                remoteRecv(fds_[i], &statsHeader, sizeof(statsHeader));
+      if (ok){
+        stats.resize(statsHeader.statsNum);
+        ok = statsHeader.statsNum == 0 ||
+             remoteRecv(fds_[i], &stats[0], statsHeader.statsNum * sizeof(NodeStat));
+      }
+
+      pthread_mutex_lock(&mutex_);
+      if (ok && statsHeader.search != search_){
+        //late statistics of the previous search
+        pthread_mutex_unlock(&mutex_);
+        continue;
+      }
+      if (ok){
+        //statistics are cumulative - the latest one is kept
+        stats_[i].swap(stats);
+        playouts_[i] = statsHeader.playouts;
+        final_[i] = statsHeader.final;
+      }
+      else{
+        logWarning("Remote worker %d disconnected.", i);
+        alive[i] = false;
+        final_[i] = true;
+      }
+      pthread_cond_broadcast(&finalCond_);
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorkers::sendAll(remoteMsg_e type, const void* data, int size)
+{
+  for (int i = 0; i < workersNum_; i++){
+    remoteSend(fds_[i], type, data, size);
+  }
+}
+
+//---------------------------------------------------------------------
+//  section RemoteWorker
+//---------------------------------------------------------------------
+
+RemoteWorker::RemoteWorker()
+{
+  assert(false);
+}
+
+//---------------------------------------------------------------------
+
+RemoteWorker::RemoteWorker(const string& address)
+{
+  fd_ = -1;
+  search_ = 0;
+  size_t colon = address.rfind(':');
+  if (colon == string::npos){
+    logError("Wrong coordinator address %s.", address.c_str());
+    return;
+  }
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(str2int(address.substr(colon + 1)));
+  if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) != 1){
+    logError("Wrong coordinator address %s.", address.c_str());
+    return;
+  }
+
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd_ < 0 || connect(fd_, (sockaddr*) &addr, sizeof(addr)) < 0){
+    logError("Couldn't connect to coordinator %s.", address.c_str());
+    if (fd_ >= 0){
+      close(fd_);
+    }
+    fd_ = -1;
+    return;
+  }
+  int flag = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+//---------------------------------------------------------------------
+
+RemoteWorker::~RemoteWorker()
+{
+  if (fd_ >= 0){
+    close(fd_);
+  }
+}
+
+//---------------------------------------------------------------------
+
+void RemoteWorker::run()
+{
+  if (fd_ < 0){
+    return;
+  }
+
+  //static board structures (hash tables, eval) are initialized with the first board
+  Board* board = new Board();
+  board->initNewGame();
+
+  RemoteHeader header;
+  while (remoteRecv(fd_, &header, sizeof(header))){
+    if (header.type == RM_QUIT){
+      break;
+    }
+    if (header.type == RM_STOP){
+      //stop came after the search was finished
+      continue;
+    }
+    if (header.type != RM_SEARCH || header.size != sizeof(Board) ||
+        ! remoteRecv(fd_, board, sizeof(Board))){
+      logError("Wrong message from coordinator.");
+      break;
+    }
+    search_++;
+    if (! search(board)){
+      break;
+    }
+  }
+  delete board;
+}
+
+//---------------------------------------------------------------------
+
+bool RemoteWorker::search(const Board* board)
+{
+  Uct* uct = new Uct(board);
+  Timer timer(REMOTE_STATS_INTERVAL);
+  timer.start();
+
+  bool ok = true;
+  int playouts = 0;
+  while (true){
+    uct->doPlayout(board);
+    if (++playouts % REMOTE_POLL_PLAYOUTS){
+      continue;
+    }
+    bool stop = stopRequested();
+    if (stop || timer.timeUp()){
+      ok = sendStats(uct, stop);
+      timer.start();
+    }
+    if (stop || ! ok){
+      break;
+    }
+  }
+
+  delete uct;
+  return ok;
+}
+
+//---------------------------------------------------------------------
+
+bool RemoteWorker::sendStats(Uct* uct, bool final)
+{
+  NodeStats stats;
+  uct->getTree()->collectFirstMoveStats(stats, REMOTE_MIN_VISITS);
+
+  RemoteStatsHeader statsHeader;
+  statsHeader.search = search_;
+  statsHeader.playouts = uct->getPlayoutsNum();
+  statsHeader.final = final;
+  statsHeader.statsNum = stats.size();
+
+  string payload((const char*) &statsHeader, sizeof(statsHeader));
+  payload.append((const char*) &stats[0], stats.size() * sizeof(NodeStat));
+  return remoteSend(fd_, RM_STATS, payload.data(), payload.size());
+}
+
+//---------------------------------------------------------------------
+
+bool RemoteWorker::stopRequested()
+{
+  pollfd pfd;
+  pfd.fd = fd_;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0) <= 0){
+    return false;
+  }
+  //stop (or anything else - lost connection) ends the search
+  RemoteHeader header;
+  if (remoteRecv(fd_, &header, sizeof(header)) && 
+      (header.type == RM_STOP || header.type == RM_QUIT)){
+    return true;
+  }
+  logError("Unexpected message from coordinator.");
+  return true;
+}
+
+//---------------------------------------------------------------------
+//---------------------------------------------------------------------
@@ -0,0 +1,206 @@
+/**
+ * @file remote.h
+ *
+ * @brief Root parallelization over processes.
+ * @full Coordinator spawns worker processes (akimot in worker mode) and
+ * connects them over sockets. Workers search the position in their own trees
+ * and periodically stream the statistics of the first move back.
+ * Statistics are merged into the coordinator's tree after the search.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include "utils.h"
+#include "board.h"
+#include "uct.h"
+
+#define MAX_REMOTE_WORKERS 64
+//how often workers send their statistics (seconds)
+#define REMOTE_STATS_INTERVAL 0.2
+//how often workers check for the stop (playouts)
+#define REMOTE_POLL_PLAYOUTS 64
+//minimal visits of the node to be sent
+#define REMOTE_MIN_VISITS 10
+//how long coordinator waits for the final statistics (seconds)
+#define REMOTE_WAIT_TIME 0.5
+//how long coordinator waits for workers to connect (seconds)
+#define REMOTE_CONNECT_TIME 5
+
+enum remoteMsg_e {RM_SEARCH, RM_STOP, RM_STATS, RM_QUIT};
+
+/**
+ * Message header.
+ *
+ * Followed by size bytes of the payload.
+ */
+struct RemoteHeader
+{
+  int type;
+  int size;
+};
+
+/**
+ * Header of the statistics payload.
+ *
+ * Followed by statsNum NodeStat records.
+ */
+struct RemoteStatsHeader
+{
+  /**Search (counted from 1) the statistics belong to.*/
+  int search;
+  int playouts;
+  int final;
+  int statsNum;
+};
+
+/**
+ * Coordinator side of the root parallelization.
+ *
+ * Worker processes are spawned once and kept for next searches.
+ * Collector thread reads the streamed statistics and keeps the latest
+ * one of every worker.
+ */
+class RemoteWorkers
+{
+  public:
+    /**
+     * Spawns the workers and waits for them to connect.
+     */
+    RemoteWorkers(int workersNum);
+
+    /**
+     * Quits the workers.
+     */
+    ~RemoteWorkers();
+
+    /**
+     * Sends the position to workers and starts their search.
+     */
+    void startSearch(const Board* board);
+
+    /**
+     * Stops the workers.
+     *
+     * Waits (at most REMOTE_WAIT_TIME) for the final statistics.
+     */
+    void stopSearch();
+
+    /**
+     * Merges the latest statistics of all workers to the uct.
+     *
+     * @param board Searched position (repetitions are filtered against it).
+     */
+    void mergeStatistics(Uct* uct, const Board* board);
+
+    /**
+     * Number of connected workers.
+     */
+    int getWorkersNum() const;
+
+    /**
+     * Number of workers requested in the constructor.
+     */
+    int getRequestedNum() const;
+
+  private:
+    RemoteWorkers();
+
+    /**
+     * Spawns the workers and accepts their connections.
+     */
+    void connectWorkers(int workersNum);
+
+    /**
+     * Forks and executes akimot in worker mode.
+     */
+    bool spawnWorker(int port);
+
+    static void* collectorWrapper(void* instance);
+
+    /**
+     * Reads messages from workers until quit.
+     */
+    void collectorLoop();
+
+    /**
+     * Sends message to all workers.
+     */
+    void sendAll(remoteMsg_e type, const void* data, int size);
+
+    int workersNum_;
+    int requestedNum_;
+    int fds_[MAX_REMOTE_WORKERS];
+    pid_t pids_[MAX_REMOTE_WORKERS];
+    int pidsNum_;
+
+    /**Latest statistics of workers.*/
+    NodeStats stats_[MAX_REMOTE_WORKERS];
+    int playouts_[MAX_REMOTE_WORKERS];
+    bool final_[MAX_REMOTE_WORKERS];
+    /**Search counter - late statistics are recognized.*/
+    int search_;
+
+    pthread_t collector_;
+    pthread_mutex_t mutex_;
+    /**Signals final statistics.*/
+    pthread_cond_t finalCond_;
+    bool quit_;
+};
+
+/**
+ * Worker side of the root parallelization.
+ *
+ * Connects to the coordinator and serves its search requests.
+ */
+class RemoteWorker
+{
+  public:
+    /**
+     * @param address Coordinator address host:port.
+     */
+    RemoteWorker(const string& address);
+    ~RemoteWorker();
+
+    /**
+     * Serves the requests until quit (or lost connection).
+     */
+    void run();
+
+  private:
+    RemoteWorker();
+
+    /**
+     * Searches until stop, streams the statistics.
+     */
+    bool search(const Board* board);
+
+    /**
+     * Sends statistics of the uct.
+     */
+    bool sendStats(Uct* uct, bool final);
+
+    /**
+     * Non blocking check for the stop message.
+     */
+    bool stopRequested();
+
+    int fd_;
+    /**Search counter (matches the coordinator's one).*/
+    int search_;
+};
+
+/**
+ * Sends whole message.
+ *
+ * @return False if connection is lost.
+ */
+bool remoteSend(int fd, remoteMsg_e type, const void* data, int size);
+
+/**
+ * Receives whole buffer.
+ *
+ * @return False if connection is lost.
+ */
+bool remoteRecv(int fd, void* data, int size);
@@ -15,7 +15,11 @@
 #define TRAPCHECK_TEST_LIST "./data/trapcheck/list.txt"
 #define STEP_KILL_PRINT_TEST_LIST "./data/step_kill_print/list.txt"
 #define STEP_KILL_PRINT_TEST_DIR "./data/step_kill_print/"
+#define STEP_COMMUTE_POSITIONS 300
+#define STEP_COMMUTE_MAX_WALK 40
 #define HASH_TABLE_INSERTS 100
+//small table for the probing tests (keys are placed to chosen slots)
+#define HASH_TABLE_TEST_SIZE 64
 
 //mature level is defined in uct.h
 #define UCT_TREE_TEST_MATURE 1 
@@ -25,6 +29,16 @@
 
 class FileRead;
 
+/**
+ * Hash table with accessible generation (for the wraparound test).
+ */
+template<typename T> class HashTableTest : public HashTable<T>
+{
+  public:
+    HashTableTest(uint capacity): HashTable<T>(capacity) {}
+    void setGeneration(uint generation) { this->generation_ = generation; }
+};
+
 //#define VERBOSE_TESTS
 #ifdef VERBOSE_TESTS
   #define DEBUG_TESTS(x) x
@@ -125,6 +139,78 @@ class DebugTestSuite : public CxxTest::TestSuite
  
     } 
 
+    /**
+     * Commuting steps lead to the same position in both orders.
+     *
+     * Pairs of steps within a move are checked in random positions 
+     * (random walk from the start position).
+     */
+    void testStepCommutation(void)
+    {
+      for (int k = 0; k < STEP_COMMUTE_POSITIONS; k++){
+        Board* b = new Board();
+        assert(b->initFromPosition(START_POS));
+        for (int i = 0; i < k % STEP_COMMUTE_MAX_WALK && b->getWinner() == NO_PLAYER; i++){
+          StepArray steps;
+          int stepsNum = b->genStepsNoPass(b->getPlayerToMove(), steps);
+          if (! stepsNum){
+            break;
+          }
+          b->makeStepTryCommit(steps[rand() % stepsNum]);
+        }
+        if (b->getWinner() != NO_PLAYER){
+          delete b;
+          continue;
+        }
+
+        StepArray first;
+        int firstNum = b->genStepsNoPass(b->getPlayerToMove(), first);
+        for (int i = 0; i < firstNum; i++){
+          Board b1(*b);
+          //second step must be in the same move
+          if (b1.makeStepTryCommit(first[i])){
+            continue;
+          }
+          StepArray second;
+          int secondNum = b1.genStepsNoPass(b1.getPlayerToMove(), second);
+          for (int j = 0; j < secondNum; j++){
+            if (! first[i].commutes(second[j])){
+              continue;
+            }
+            Board b12(b1);
+            b12.makeStepTryCommit(second[j]);
+
+            //reversed order - both steps must be playable 
+            Board b21(*b);
+            StepArray steps;
+            int stepsNum = b21.genStepsNoPass(b21.getPlayerToMove(), steps);
+            bool found = false;
+            for (int l = 0; l < stepsNum && ! found; l++){
+              found = steps[l] == second[j];
+            }
+            TS_ASSERT(found);
+            if (! found){
+              continue;
+            }
+            b21.makeStepTryCommit(second[j]);
+            stepsNum = b21.genStepsNoPass(b21.getPlayerToMove(), steps);
+            found = false;
+            for (int l = 0; l < stepsNum && ! found; l++){
+              found = steps[l] == first[i];
+            }
+            TS_ASSERT(found);
+            if (! found){
+              continue;
+            }
+            b21.makeStepTryCommit(first[i]);
+
+            TS_ASSERT_EQUALS(b12.getSignature(), b21.getSignature());
+          }
+        }
+        delete b;
+      }
+    }
+
 
     void testRandom(void){
 
@@ -292,6 +378,187 @@ class DebugTestSuite : public CxxTest::TestSuite
       }
     }
 
+    /**
+     * Hash table remove inside of a probe cluster.
+     *
+     * Keys with high half zero go to the slot given by the low bits.
+     */
+    void testHashTableRemove(void)
+    {
+      HashTable<int> hashTable(HASH_TABLE_TEST_SIZE); 
+      int item;
+
+      //cluster 5..9: three keys from home 5, one from 6, one from 7
+      u64 keys[] = {5, 5 + HASH_TABLE_TEST_SIZE, 6, 5 + 2 * HASH_TABLE_TEST_SIZE, 7};
+      int keysNum = sizeof(keys) / sizeof(u64);
+      for (int i = 0; i < keysNum; i++){
+        hashTable.insertItem(keys[i], i);
+      }
+
+      //removal from the cluster head shifts the rest back
+      hashTable.removeItem(keys[0]);
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[0]), false); 
+      for (int i = 1; i < keysNum; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, i); 
+      }
+
+      //removal from the middle of the cluster
+      hashTable.removeItem(keys[2]);
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[2]), false); 
+      for (int i = 1; i < keysNum; i++){
+        if (i != 2){
+          TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+          TS_ASSERT_EQUALS(item, i); 
+        }
+      }
+
+      //removal of missing key changes nothing
+      hashTable.removeItem(keys[0]);
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[1]), true); 
+
+      //rest of the cluster
+      hashTable.removeItem(keys[1]);
+      hashTable.removeItem(keys[3]);
+      hashTable.removeItem(keys[4]);
+      TS_ASSERT_EQUALS(hashTable.isEmpty(), true); 
+
+      //hole is reused by the insert
+      hashTable.insertItem(keys[3], 3);
+      TS_ASSERT_EQUALS(hashTable.loadItem(keys[3], item), true); 
+      TS_ASSERT_EQUALS(item, 3); 
+    }
+
+    /**
+     * Hash table clear and reinsert (including generation wraparound).
+     */
+    void testHashTableClear(void)
+    {
+      HashTableTest<int> hashTable(HASH_TABLE_TEST_SIZE); 
+      u64 keys[HASH_TABLE_TEST_SIZE / 2];
+      int item;
+
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 2; i++){
+        keys[i] = getRandomU64();
+        hashTable.insertItem(keys[i], i);
+      }
+      hashTable.clear();
+      TS_ASSERT_EQUALS(hashTable.isEmpty(), true); 
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 2; i++){
+        TS_ASSERT_EQUALS(hashTable.hasItem(keys[i]), false); 
+      }
+
+      //reinsert with other items
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 2; i++){
+        hashTable.insertItem(keys[i], -i);
+      }
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 2; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, -i); 
+      }
+
+      //items of the first generation must not come back after the wraparound
+      HashTableTest<int> wrapTable(HASH_TABLE_TEST_SIZE); 
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 4; i++){
+        wrapTable.insertItem(keys[i], i);
+      }
+      wrapTable.setGeneration(uint(-1));
+      TS_ASSERT_EQUALS(wrapTable.hasItem(keys[1]), false); 
+      wrapTable.insertItem(keys[0], 0);
+      wrapTable.clear();
+      TS_ASSERT_EQUALS(wrapTable.isEmpty(), true); 
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE / 2; i++){
+        TS_ASSERT_EQUALS(wrapTable.hasItem(keys[i]), false); 
+      }
+      wrapTable.insertItem(keys[1], 1);
+      TS_ASSERT_EQUALS(wrapTable.loadItem(keys[1], item), true); 
+      TS_ASSERT_EQUALS(item, 1); 
+      TS_ASSERT_EQUALS(wrapTable.hasItem(keys[2]), false); 
+    }
+
+    /**
+     * Hash table with full probe window.
+     *
+     * Item in the home slot is replaced, the rest of the window is kept.
+     */
+    void testHashTableFull(void)
+    {
+      HashTable<int> hashTable(HASH_TABLE_TEST_SIZE); 
+      u64 keys[HASH_TABLE_MAX_PROBE + 1];
+      int item;
+
+      //all keys share home slot 3
+      for (int i = 0; i <= HASH_TABLE_MAX_PROBE; i++){
+        keys[i] = 3 + u64(i) * HASH_TABLE_TEST_SIZE;
+      }
+      for (int i = 0; i < HASH_TABLE_MAX_PROBE; i++){
+        hashTable.insertItem(keys[i], i);
+      }
+      for (int i = 0; i < HASH_TABLE_MAX_PROBE; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, i); 
+      }
+
+      //window is full - home slot is replaced
+      hashTable.insertItem(keys[HASH_TABLE_MAX_PROBE], HASH_TABLE_MAX_PROBE);
+      TS_ASSERT_EQUALS(hashTable.loadItem(keys[HASH_TABLE_MAX_PROBE], item), true); 
+      TS_ASSERT_EQUALS(item, HASH_TABLE_MAX_PROBE); 
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[0]), false); 
+      for (int i = 1; i < HASH_TABLE_MAX_PROBE; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, i); 
+      }
+
+      //update of the key in the window doesn't replace anything
+      hashTable.insertItem(keys[5], 50);
+      TS_ASSERT_EQUALS(hashTable.loadItem(keys[5], item), true); 
+      TS_ASSERT_EQUALS(item, 50); 
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[HASH_TABLE_MAX_PROBE]), true); 
+
+      //removal of the replacing key shifts the window back
+      hashTable.removeItem(keys[HASH_TABLE_MAX_PROBE]);
+      TS_ASSERT_EQUALS(hashTable.hasItem(keys[HASH_TABLE_MAX_PROBE]), false); 
+      for (int i = 1; i < HASH_TABLE_MAX_PROBE; i++){
+        TS_ASSERT_EQUALS(hashTable.hasItem(keys[i]), true); 
+      }
+    }
+
+    /**
+     * Hash table growing up to the maximal capacity.
+     */
+    void testHashTableGrow(void)
+    {
+      HashTable<int> hashTable(HASH_TABLE_TEST_SIZE, HASH_TABLE_TEST_SIZE * 16); 
+      u64 keys[HASH_TABLE_TEST_SIZE * 4];
+      int item;
+
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE * 4; i++){
+        keys[i] = getRandomU64();
+        hashTable.insertItem(keys[i], i);
+      }
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE * 4; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, i); 
+      }
+
+      //grown table is kept by the clear
+      hashTable.clear();
+      TS_ASSERT_EQUALS(hashTable.isEmpty(), true); 
+      for (int i = 0; i < HASH_TABLE_TEST_SIZE * 4; i++){
+        TS_ASSERT_EQUALS(hashTable.hasItem(keys[i]), false); 
+      }
+
+      //full probe window makes the table grow instead of the replacement
+      for (int i = 0; i <= HASH_TABLE_MAX_PROBE; i++){
+        keys[i] = 3 + u64(i) * HASH_TABLE_TEST_SIZE;
+        hashTable.insertItem(keys[i], i);
+      }
+      for (int i = 0; i <= HASH_TABLE_MAX_PROBE; i++){
+        TS_ASSERT_EQUALS(hashTable.loadItem(keys[i], item), true); 
+        TS_ASSERT_EQUALS(item, i); 
+      }
+    }
+
     /**
      * Uct test.
      *
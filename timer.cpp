@@ -26,59 +26,158 @@ void Timer::setTimer(double swTime)
 
 double Timer::now()
 {
-  timeval t;
-  gettimeofday(&t, NULL); 
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t); 
   return toSeconds(t);
 }
 
 //--------------------------------------------------------------------- 
 
+timespec Timer::toTimespec(double seconds)
+{
+  timespec t;
+  t.tv_sec = time_t(seconds);
+  t.tv_nsec = long((seconds - t.tv_sec) * NANO_IN_SEC);
+  return t;
+}
+
+//--------------------------------------------------------------------- 
+
 void Timer::start()
 {
-  timeval t;
-  gettimeofday(&t, NULL); 
-  start_ = toSeconds(t);
+  start_ = now();
 }
 
 //--------------------------------------------------------------------- 
 
 void Timer::stop()
 {
-  timeval t;
-  gettimeofday(&t, NULL); 
-
-  elapsed_ = toSeconds(t) - start_; 
+  elapsed_ = now() - start_; 
 }
 
 //--------------------------------------------------------------------- 
 
 double Timer::elapsed()
 {
-  #ifndef NDEBUG
-    timeval t;
-    gettimeofday(&t, NULL);
-    assert( toSeconds(t) - start_ >= elapsed_); 
-  #endif
+  assert( now() - start_ >= elapsed_); 
 
   return elapsed_;
 }
 
 //--------------------------------------------------------------------- 
 
+double Timer::running()
+{
+  return now() - start_;
+}
+
+//--------------------------------------------------------------------- 
+
 bool Timer::timeUp()
 {
-  timeval t;
-  gettimeofday(&t, NULL); 
-  if (toSeconds(t) - start_ >= swTime_) 
+  if (now() - start_ >= swTime_) 
     return true;
   return false;  
 }
 
 //--------------------------------------------------------------------- 
 
-double Timer::toSeconds(timeval t) 
+double Timer::toSeconds(timespec t) 
+{
+  return t.tv_sec + t.tv_nsec / double(NANO_IN_SEC);
+}
+
+//---------------------------------------------------------------------
+//  section DeadlineTimer
+//---------------------------------------------------------------------
+
+DeadlineTimer::DeadlineTimer()
+{
+  expired_ = false;
+  armed_ = false;
+  quit_ = false;
+  deadline_ = 0;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cond_, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&mutex_, NULL);
+
+  pthread_create(&thread_, NULL, DeadlineTimer::timerWrapper, (void*)this);
+}
+
+//--------------------------------------------------------------------- 
+
+DeadlineTimer::~DeadlineTimer()
+{
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+
+  pthread_join(thread_, NULL);
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+//--------------------------------------------------------------------- 
+
+void DeadlineTimer::arm(double seconds)
+{
+  pthread_mutex_lock(&mutex_);
+  expired_ = false;
+  armed_ = true;
+  deadline_ = Timer::now() + seconds;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+//--------------------------------------------------------------------- 
+
+void DeadlineTimer::disarm()
+{
+  pthread_mutex_lock(&mutex_);
+  armed_ = false;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+//--------------------------------------------------------------------- 
+
+double DeadlineTimer::getDeadline() const
+{
+  return deadline_;
+}
+
+//--------------------------------------------------------------------- 
+
+void* DeadlineTimer::timerWrapper(void* instance)
+{
+  ((DeadlineTimer*)instance)->timerLoop();
+  return NULL;
+}
+
+//--------------------------------------------------------------------- 
+
+void DeadlineTimer::timerLoop()
 {
-  return t.tv_sec + t.tv_usec / double(MICRO_IN_SEC);
+  pthread_mutex_lock(&mutex_);
+  while (! quit_){
+    if (! armed_){
+      pthread_cond_wait(&cond_, &mutex_);
+      continue;
+    }
+    //spurious wakeups and rearming are resolved by the clock check
+    timespec deadline = Timer::toTimespec(deadline_);
+    pthread_cond_timedwait(&cond_, &mutex_, &deadline);
+    if (armed_ && Timer::now() >= deadline_){
+      expired_ = true;
+      armed_ = false;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
 }
 
 //--------------------------------------------------------------------- 
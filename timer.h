@@ -3,16 +3,20 @@
  *
  * @brief Timer class declaration. 
  * @full Timer mechanism is used for timing the time allocated to search.
+ * All times are measured on the monotonic clock.
  */
 
 #pragma once
 
 #include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
 #include <iostream>
 #include <ostream>
 #include <cassert>
 
 #define MICRO_IN_SEC 1000000
+#define NANO_IN_SEC 1000000000
 
 using std::cout;
 using std::endl;
@@ -31,9 +35,14 @@ class Timer
     Timer(double swTime);
 
     /**
-     * Time in seconds.
+     * Time in seconds (monotonic clock).
      */
-    double now();
+    static double now();
+
+    /**
+     * Seconds -> timespec conversion (for the timed waits).
+     */
+    static timespec toTimespec(double seconds);
 
     /**
      * Set timer interval.
@@ -55,6 +64,11 @@ class Timer
      */
     double elapsed(); 
 
+    /**
+     * Time elapsed since start (timer is still running).
+     */
+    double running(); 
+
     /**
      * Check timer.
      *
@@ -64,9 +78,9 @@ class Timer
 
   private: 
     /**
-     * Timeval -> seconds conversion.
+     * Timespec -> seconds conversion.
      */
-    double toSeconds(timeval t);
+    static double toSeconds(timespec t);
 
     /** Start in seconds. */
     double start_;
@@ -77,3 +91,62 @@ class Timer
     /** Elapsed time.*/
     double elapsed_;
 };
+
+/**
+ * Deadline timer.
+ *
+ * Own thread sleeps (on the monotonic clock) until the deadline 
+ * and raises the flag then. Searchers only read the flag instead 
+ * of querying the clock in every playout. The thread is kept 
+ * for the whole life of the timer.
+ */
+class DeadlineTimer
+{
+  public:
+    DeadlineTimer();
+
+    /**
+     * Stops and joins the timer thread.
+     */
+    ~DeadlineTimer();
+
+    /**
+     * Arms the timer.
+     *
+     * Flag is cleared and raised again after given number of seconds.
+     */
+    void arm(double seconds);
+
+    /**
+     * Disarms the timer (flag is left untouched).
+     */
+    void disarm();
+
+    /**
+     * Deadline flag.
+     */
+    inline bool expired() const { return expired_; }
+
+    /**
+     * Time of the deadline (in Timer::now() units).
+     */
+    double getDeadline() const;
+
+  private:
+    static void* timerWrapper(void* instance);
+
+    /**
+     * Waits for the deadlines until quit.
+     */
+    void timerLoop();
+
+    volatile bool expired_;
+    bool armed_;
+    bool quit_;
+    double deadline_;
+
+    pthread_t thread_;
+    pthread_mutex_t mutex_;
+    /**Cond (on the monotonic clock) signaling (dis)arming.*/
+    pthread_cond_t cond_;
+};
@@ -89,7 +89,7 @@ AdvisorPlayout::AdvisorPlayout(Board* board, uint maxPlayoutLength, uint evalAft
 void AdvisorPlayout::playOne()
 {
   Move move;
-  if (cfg.moveAdvisor() && glob.grand()->get01() < cfg.moveAdvisor() && 
+  if (advisor_ && cfg.moveAdvisor() && glob.grand()->get01() < cfg.moveAdvisor() && 
       advisor_->getMove(board_->getPlayerToMove(), board_->getBitboard(), 
       board_->getStepCountLeft(), &move)){
     board_->makeMove(move);
@@ -100,1001 +100,2745 @@ void AdvisorPlayout::playOne()
 }
 
 //---------------------------------------------------------------------
-// section TWstep
+// section PlayoutPool
 //---------------------------------------------------------------------
 
-
-TWstep::TWstep(Step s, float val, int vis) :
-step(s), value(val), visits(vis)
+PlayoutPool::PlayoutPool()
 {
+  assert(false);
 }
 
 //---------------------------------------------------------------------
-// section TWsteps 
+
+PlayoutPool::PlayoutPool(int workersNum, int firstCore): 
+  workersNum_(min(workersNum, MAX_THREADS)), firstCore_(firstCore)
+{
+  uct_ = NULL;
+  started_ = 0;
+  leaf_ = NULL;
+  playoutLen_ = 0;
+  batch_ = 0;
+  running_ = 0;
+  sampleSum_ = 0;
+  quit_ = false;
+
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&workCond_, NULL);
+  pthread_cond_init(&doneCond_, NULL);
+
+  for (int i = 0; i < workersNum_; i++){
+    int rc = pthread_create(&threads_[i], NULL, PlayoutPool::workerWrapper, (void*) this);
+    if (rc) {
+      stringstream ss;
+      ss << "Fatal thread error no. " << rc << " when creating playout worker.";
+      logError(ss.str().c_str());
+      exit(1);
+    } 
+  }
+}
+
 //---------------------------------------------------------------------
 
-TWstep& TWsteps::operator[](const Step& step)
-{ 
-  TWsteps::iterator it = find(step);
-  if (it != end()){
-    return it->second;
+PlayoutPool::~PlayoutPool()
+{
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_broadcast(&workCond_);
+  pthread_mutex_unlock(&mutex_);
+
+  for (int i = 0; i < workersNum_; i++){
+    pthread_join(threads_[i], NULL);
   }
 
-  pair< TWsteps::iterator, bool> p;
-  p = insert(make_pair(step, TWstep(step, 0, 1)));
-  assert(p.second);
-  return p.first->second;
+  pthread_cond_destroy(&doneCond_);
+  pthread_cond_destroy(&workCond_);
+  pthread_mutex_destroy(&mutex_);
+  delete leaf_;
 }
 
-//---------------------------------------------------------------------
-// section TTitem
 //---------------------------------------------------------------------
 
-TTitem::TTitem() 
-{ 
-  assert(false);
+void PlayoutPool::startPlayouts(const Uct* uct, const Board* leaf, uint playoutLen)
+{
+  pthread_mutex_lock(&mutex_);
+  assert(running_ == 0);
+  uct_ = uct;
+  //workers are idle - previous leaf might be dropped
+  delete leaf_;
+  leaf_ = new Board(*leaf);
+  playoutLen_ = playoutLen;
+  sampleSum_ = 0;
+  running_ = workersNum_;
+  batch_++;
+  pthread_cond_broadcast(&workCond_);
+  pthread_mutex_unlock(&mutex_);
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-TTitem::TTitem(NodeList* nodes) 
+float PlayoutPool::waitPlayouts()
 {
-  visits_ = 0; 
-  value_ = 0; 
-  nodes_ = nodes;
+  pthread_mutex_lock(&mutex_);
+  while (running_ > 0){
+    pthread_cond_wait(&doneCond_, &mutex_);
+  }
+  float sampleSum = sampleSum_;
+  pthread_mutex_unlock(&mutex_);
+  return sampleSum;
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-NodeList* TTitem::getNodes() const
+int PlayoutPool::getWorkersNum() const
 {
-  return nodes_;
+  return workersNum_;
 }
 
-//---------------------------------------------------------------------
-// section Node
 //---------------------------------------------------------------------
 
-Node::Node()
+void* PlayoutPool::workerWrapper(void* pool)
 {
-  assert(false);
+  ((PlayoutPool*) pool)->workerLoop();
+  return NULL;
 }
 
 //---------------------------------------------------------------------
 
-Node::~Node()
+void PlayoutPool::workerLoop()
 {
-  delete cCache_;
-  //representant deletes the ttitem
-  if (ttItem_ && ttItem_->nodes_ && ttItem_->nodes_->front() == this){
-    delete ttItem_->nodes_;
-    delete ttItem_;
+  pthread_mutex_lock(&mutex_);
+  int index = started_++;
+  pthread_mutex_unlock(&mutex_);
+
+  if (firstCore_ >= 0 && ! pinThreadToCore(firstCore_ + index)){
+    logWarning("Pinning playout worker to core failed.");
   }
-   
-}
 
+  int batch = 0;
+  while (true){
+    pthread_mutex_lock(&mutex_);
+    while (! quit_ && batch == batch_){
+      pthread_cond_wait(&workCond_, &mutex_);
+    }
+    if (quit_){
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    batch = batch_;
+    pthread_mutex_unlock(&mutex_);
+
+    //leaf is not touched until all workers are done
+    Board* playBoard = new Board(*leaf_);
+    //context moves are shared with the uct, played ones are worker's
+    MoveAdvisor advisor(uct_->advisor_->getContextMoves());
+    AdvisorPlayout playoutManager(playBoard, MAX_PLAYOUT_LENGTH, playoutLen_, &advisor);
+    playoutManager.doPlayout();
+    float sample = uct_->decidePlayoutWinner(playBoard);
+    if (cfg.moveAdvisor()){
+      advisor.update(sample);
+    }
+    delete playBoard;
+
+    pthread_mutex_lock(&mutex_);
+    sampleSum_ += sample;
+    if (--running_ == 0){
+      pthread_cond_signal(&doneCond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+  glob.releaseThread();
+}
 
+//---------------------------------------------------------------------
+// section Task
 //---------------------------------------------------------------------
 
-Node::Node(TWstep* twStep, float heur)
+Task::Task()
 {
-  pthread_mutex_init(&mutex, NULL);
-  assert(IS_PLAYER(twStep->step.getPlayer()));
-  firstChild_ = NULL;
-  sibling_    = NULL;
-  father_     = NULL;  
-  visits_     = cfg.vv();
-  value_      = 0; 
-  squareSum_  = 0;
-  heur_       = heur; 
-  twStep_     = twStep;
-  ttItem_      = NULL;
-  master_     = NULL;
-  //full cCache_ initialization in node::expand
-  cCache_     = NULL;
-  
-  masterValue_  = value_;
-  masterVisits_ = visits_;
+  done_ = false;
+  cancelled_ = false;
 }
 
 //---------------------------------------------------------------------
 
-Node* Node::findUctChild(Node* realFather) 
+Task::~Task()
 {
-  assert(this->firstChild_ != NULL);
-  assert(realFather != NULL);
-  
-  Node* act = firstChild_;
-  Node* best = firstChild_;
-  float bestUrgency = INT_MIN;   
-  
-  //dynamic exploreRate tuning 
-  float exploreRate = cfg.ucbTuned() ? 1 : 
-                                  (cfg.dynamicExploration() ? 
-                                  max(0.01, min(0.25, 3.5 * (double(squareSum_)/visits_)))
-                                  : cfg.exploreRate());
-  float exploreCoeff = exploreRate * log(realFather->visits_);
+}
 
-  if (cCache_ &&  visits_ > CCACHE_START_THRESHOLD){
-    //using children cache
-    assert(cCache_);
-    cCacheUpdate(exploreCoeff); 
-    for (int i = 0; i < CHILDREN_CACHE_SIZE && cCache_[i]; i++){
-      act = cCache_[i];   
-      uctOneChild(act, best, bestUrgency, exploreCoeff);
-    }
-  }else{
-    while (act != NULL) {
-      uctOneChild(act, best, bestUrgency, exploreCoeff);
-      act = act->sibling_;
-    }
-  }
+//---------------------------------------------------------------------
 
-  return best;
+void Task::cancel()
+{
+  cancelled_ = true;
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
+// section TaskPool
+//---------------------------------------------------------------------
 
-Node* Node::findRandomChild() const
+TaskPool::TaskPool()
 {
-  Node* node = firstChild_;
-  assert(node != NULL);
-  int childNum = 0; 
+  assert(false);
+}
 
-  //count children
-  while (node != NULL) {
-    node = node->sibling_;
-    childNum++; 
-  }    
+//---------------------------------------------------------------------
 
-  //select children to be played  
-  childNum = random() % childNum;
+TaskPool::TaskPool(int workersNum): 
+  workersNum_(min(max(workersNum, 1), MAX_THREADS))
+{
+  next_ = 0;
+  pending_ = 0;
+  started_ = 0;
+  waiters_ = 0;
+  quit_ = false;
 
-  node = firstChild_;
-  for (int i=0; i < childNum; i++){
-    assert(node != NULL);
-    node = node->sibling_;
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&workCond_, NULL);
+  pthread_cond_init(&doneCond_, NULL);
+
+  for (int i = 0; i < workersNum_; i++){
+    pthread_mutex_init(&queues_[i].mutex, NULL);
+  }
+  for (int i = 0; i < workersNum_; i++){
+    int rc = pthread_create(&threads_[i], NULL, TaskPool::workerWrapper, (void*) this);
+    if (rc) {
+      stringstream ss;
+      ss << "Fatal thread error no. " << rc << " when creating task worker.";
+      logError(ss.str().c_str());
+      exit(1);
+    } 
   }
-  return node; 
 }
 
 //---------------------------------------------------------------------
 
-Node* Node::findMostExploredChild() const
+TaskPool::~TaskPool()
 {
-  assert(this->firstChild_ != NULL);
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_broadcast(&workCond_);
+  pthread_mutex_unlock(&mutex_);
 
-  Node* best = this->firstChild_;
-  Node* act = this->firstChild_;
-  while (act != NULL) {
-    if ( act->visits_ > best->visits_ )
-      best = act;
-    act = act->sibling_;
+  for (int i = 0; i < workersNum_; i++){
+    pthread_join(threads_[i], NULL);
+    pthread_mutex_destroy(&queues_[i].mutex);
   }
-  return best;
+
+  pthread_cond_destroy(&doneCond_);
+  pthread_cond_destroy(&workCond_);
+  pthread_mutex_destroy(&mutex_);
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::cCacheInit(){
-  cCache_ = new Node*[CHILDREN_CACHE_SIZE];
-  assert(cCache_);
-  for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
-    cCache_[i] = NULL;
-  }
-  cCacheLastUpdate_ = 0;
+void TaskPool::submit(Task* task)
+{
+  int index = __sync_fetch_and_add(&next_, 1) % workersNum_;
+  //pending is changed together with the queue - it never drops below 0
+  pthread_mutex_lock(&queues_[index].mutex);
+  queues_[index].tasks.push_back(task);
+  __sync_add_and_fetch(&pending_, 1);
+  pthread_mutex_unlock(&queues_[index].mutex);
+
+  //pending is checked under the mutex by workers going to sleep
+  pthread_mutex_lock(&mutex_);
+  pthread_cond_signal(&workCond_);
+  pthread_mutex_unlock(&mutex_);
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::cCacheUpdate(float exploreCoeff)
+void TaskPool::wait(Task* task)
 {
-  if (floor(sqrt(visits_)) <= cCacheLastUpdate_)
-    return;
-
-  cCacheLastUpdate_ = int(floor(sqrt(visits_)));
-  
-  //empty cache
-  for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
-    cCache_[i] = NULL;
+  pthread_mutex_lock(&mutex_);
+  waiters_++;
+  while (! task->done_){
+    pthread_cond_wait(&doneCond_, &mutex_);
   }
+  waiters_--;
+  pthread_mutex_unlock(&mutex_);
+}
 
-  Node * act = firstChild_;
-  float actUrgency = 0;
+//---------------------------------------------------------------------
 
-  float urgencies[CHILDREN_CACHE_SIZE];
+int TaskPool::getWorkersNum() const
+{
+  return workersNum_;
+}
 
-  //fill cache
-  while (act != NULL) {
-    actUrgency = act->exploreFormula(exploreCoeff);
-    for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
-      if (! cCache_[i] || 
-          urgencies[i] < actUrgency ){
-        //bubbling
-        for (int j = CHILDREN_CACHE_SIZE - 1; j > i ;j--){ 
-          cCache_[j] = cCache_[j - 1]; 
-          urgencies[j] = urgencies[j - 1];
-        }
-        cCache_[i] = act;
-        urgencies[i] = actUrgency;
-        break;
-      }
-    }
-    act = act->sibling_;
-  }
+//---------------------------------------------------------------------
+
+void* TaskPool::workerWrapper(void* pool)
+{
+  ((TaskPool*) pool)->workerLoop();
+  return NULL;
 }
 
 //---------------------------------------------------------------------
 
-void Node::uctOneChild(Node* act, Node* & best, float & bestUrgency, float exploreCoeff) const
+void TaskPool::workerLoop()
 {
-  if (act->getMaster() && glob.grand()->get01() < 0.1){
-    act->syncMaster();
-  }
+  pthread_mutex_lock(&mutex_);
+  int index = started_++;
+  pthread_mutex_unlock(&mutex_);
 
-  assert(act);
-  float actUrgency = act->exploreFormula(exploreCoeff);
+  while (true){
+    Task* task = take(index);
+    if (task){
+      if (! task->cancelled_){
+        task->run();
+      }
+      finish(task);
+      continue;
+    }
 
-  if ( actUrgency > bestUrgency ){
-    best = act;
-    bestUrgency = actUrgency;
+    pthread_mutex_lock(&mutex_);
+    while (! quit_ && pending_ == 0){
+      pthread_cond_wait(&workCond_, &mutex_);
+    }
+    bool quit = quit_;
+    pthread_mutex_unlock(&mutex_);
+    if (quit){
+      break;
+    }
   }
+  glob.releaseThread();
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-float Node::exploreFormula(float exploreCoeff) const
+Task* TaskPool::take(int index)
 {
- if (visits_ == 0)
-   return FPU;
-  
-
- return (cfg.ucbTuned() ? ucbTuned(exploreCoeff) : ucb(exploreCoeff))
-        + heur_/visits_
-        + (cfg.historyHeuristic() ? ((getNodeType() == NODE_MAX ? twStep_->value : - twStep_->value) * 1.1 /mysqrt(visits_)) : 0)
-        ;
+  Task* task = NULL;
+  for (int i = 0; i < workersNum_ && ! task; i++){
+    Queue& queue = queues_[(index + i) % workersNum_];
+    pthread_mutex_lock(&queue.mutex);
+    if (! queue.tasks.empty()){
+      //own queue is LIFO (warm caches), stealing is FIFO
+      if (i == 0){
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+      else{
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      __sync_sub_and_fetch(&pending_, 1);
+    }
+    pthread_mutex_unlock(&queue.mutex);
+  }
+  return task;
 }
 
 //---------------------------------------------------------------------
 
-float Node::ucb(float exploreCoeff) const
+void TaskPool::finish(Task* task)
 {
-  return (getNodeType() == NODE_MAX ? value_ : - value_) 
-         + sqrt(exploreCoeff)/mysqrt(visits_);
+  pthread_mutex_lock(&mutex_);
+  task->done_ = true;
+  if (waiters_){
+    pthread_cond_broadcast(&doneCond_);
+  }
+  pthread_mutex_unlock(&mutex_);
 }
 
+//---------------------------------------------------------------------
+// section TacticsTask
 //---------------------------------------------------------------------
 
-float Node::ucbTuned(float exploreCoeff) const
+TacticsTask::TacticsTask()
 {
-  double v = max(0.01, min(0.25, 2 * double(squareSum_)/visits_ + 0.2 * sqrt(exploreCoeff/visits_)));
-
-  return (getNodeType() == NODE_MAX ? value_ : - value_) 
-         + sqrt(v * exploreCoeff)/mysqrt(visits_);
+  assert(false);
 }
 
 //---------------------------------------------------------------------
 
-void Node::addChild(Node* newChild)
+TacticsTask::TacticsTask(Uct* uct, Node* node, const Board* board, 
+                         const StepArray& steps, uint stepsNum, bool heuristics): 
+  uct_(uct), node_(node), stepsNum_(stepsNum), heuristics_(heuristics)
 {
-  assert(newChild->sibling_ == NULL);
-  assert(newChild->firstChild_ == NULL);
-  
-  newChild->sibling_ = this->firstChild_;
-  this->firstChild_ = newChild;
-  newChild->father_ = this;
-  //obsolete, now using connectChildrenToMaster
-  //newChild->connectToMaster();
+  board_ = new Board(*board);
+  for (uint i = 0; i < stepsNum_; i++){
+    steps_[i] = steps[i];
+  }
 }
 
-//--------------------------------------------------------------------- 
- 
-void Node::reverseChildren()
+//---------------------------------------------------------------------
+
+TacticsTask::~TacticsTask()
 {
-  Node* act = firstChild_;
-  Node* head = NULL;
-  while (act != NULL){
-    firstChild_ = act->sibling_;
-    act->sibling_ = head;
-    head = act;
-    act = firstChild_;
-  }
-  firstChild_ = head;
+  delete board_;
 }
 
 //---------------------------------------------------------------------
 
-void Node::delChildrenRec()
+void TacticsTask::run()
 {
-  //somebody else will take care
-  if (getTTitem() && getTTitem()->getNodes()->front() != this) {
-    return;
+  if (cfg.moveAdvisor()){
+    uct_->fill_advisor(board_);
   }
-
-  Node* actNode = firstChild_;
-  Node* sibling;
-  while(actNode != NULL){
-    sibling = actNode->sibling_;
-    actNode->delChildrenRec();
-    delete actNode;
-    actNode = sibling;
+  if (heuristics_){
+    board_->getHeuristics(steps_, stepsNum_, heurs_);
   }
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::connectToMaster(const bool lock)
+void TacticsTask::attach()
 {
-  if ((! getFather()) || (! getFather()->getMaster())){
+  if (! heuristics_){
     return;
   }
-
-  Node* masterFather = getFather()->getMaster(); 
-  if (lock){
-    masterFather->lock();
-  }
-  Node* child = masterFather->getFirstChild();
-
-  while (child != NULL){
-    if (child->getStep() == getStep()){
-      //add link only
-      setMaster(child);
-      if (lock){
-        masterFather->unlock();
-      }
-      return;
-    }
+  //children are linked in the reversed order of steps
+  uint i = stepsNum_;
+  Node* child = node_->getFirstChild();
+  while (child != NULL && i > 0 && child->getStep() == steps_[i - 1]){
+    child->setHeur(heurs_[--i]);
     child = child->getSibling();
   }
-
-  //if not found - create node and add to the master father
-  child = new Node(twStep_, 0);  
-  masterFather->addChild(child);
-  setMaster(child);
-  if (lock){
-    masterFather->unlock();
-  }
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
+// section TWstep
+//---------------------------------------------------------------------
 
-void Node::connectChildrenToMaster()
+TWstep::TWstep()
 {
-  if (! master_){
-    return;
-  }
-  
-  master_->lock();
-  Node* mChild = master_->getFirstChild();
-  Node* child = firstChild_;
-
-  bool addMode = mChild ? false : true;
+  reset();
+}
 
-  while (child != NULL){
-    if (addMode){
-      //add node 
-      //TODO remove the bind to local twStep
-      Node* mChildNew = new Node(child->getTWstep(), 0);  
-      master_->addChild(mChildNew);
-      child->setMaster(mChildNew);
-    }else{
-      //connect only
-      if (mChild && mChild->getStep() == child->getStep()){
-        child->setMaster(mChild);
-        mChild = mChild->getSibling();
-      }else{
-        //this shouldn't happen but it MIGHT - for instance because of tt discrepancies
-        //use lockless connection to master(father already locked)
-        child->connectToMaster(false);
-      }
-    }
-    child = child->getSibling();
-  }
-  
-  if (addMode){
-    //small hack to have the same ordering in the master and slave trees
-    master_->reverseChildren();
-  }
+//---------------------------------------------------------------------
 
-  master_->unlock();
+void TWstep::update(float sample, int count)
+{
+  u64 oldPacked;
+  Stats stats;
+  do {
+    oldPacked = packed_;
+    stats = unpack(oldPacked);
+    stats.visits += count;
+    stats.value += (sample - stats.value) * count / stats.visits;
+  } while (! __sync_bool_compare_and_swap(&packed_, oldPacked, pack(stats)));
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::syncMaster()
+void TWstep::reset()
 {
-  assert(master_);
-  master_->lock();
-  float mCombined  = master_->getValue() * master_->getVisits();
-  float mOldCombined  = masterValue_ * masterVisits_; 
-  float combined = value_ * visits_;
-  int newVisits = visits_ + master_->getVisits() - masterVisits_;
-  float newValue = (combined + mCombined - mOldCombined) / newVisits;
-  master_->setVisits(newVisits);
-  master_->setValue(newValue);
-  master_->unlock();
+  Stats stats;
+  stats.value = 0;
+  stats.visits = 1;
+  packed_ = pack(stats);
+}
 
-  assert(newVisits >= visits_);
+//---------------------------------------------------------------------
 
-  /*
-  float twStepCombined = twStep_->visits * twStep_->value;
-  twStep_->visits = twStep_->visits + newVisits - visits_;
-  twStep_->value = 
-    (twStepCombined + newVisits * newValue - combined)/twStep_->visits;
-  */
+float TWstep::getValue() const
+{
+  return unpack(packed_).value;
+}
 
-  value_ = newValue;
-  visits_= newVisits;
-  masterValue_ = newValue;
-  masterVisits_= newVisits;
+//---------------------------------------------------------------------
+
+int TWstep::getVisits() const
+{
+  return unpack(packed_).visits;
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::recSyncMaster()
+u64 TWstep::pack(const Stats& stats)
 {
-  if (! master_){
-    return;
-  }
-    
-  syncMaster();
+  assert(sizeof(Stats) == sizeof(u64));
+  u64 packed;
+  memcpy(&packed, &stats, sizeof(packed));
+  return packed;
+}
 
-  Node* child = firstChild_;
-  while(child != NULL){
-    child->recSyncMaster();
-    child = child->getSibling();
-  }
+//---------------------------------------------------------------------
+
+TWstep::Stats TWstep::unpack(u64 packed)
+{
+  Stats stats;
+  memcpy(&stats, &packed, sizeof(stats));
+  return stats;
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
+// section TWsteps 
+//---------------------------------------------------------------------
 
-void Node::updateTTbrothers(float sample, int size)
+TWsteps::TWsteps()
 {
-  //update in ttNodes
-  if (getTTitem()) {
-      ttItem_->value_ = 
-        (ttItem_->value_ * ttItem_->visits_ + sample)/(ttItem_->visits_ + size);
-      ttItem_->visits_ += size;
-      //cerr << ttItem_->visits_ << " " << ttItem_->value_ << endl;
-      
-    NodeList * nl = getTTitem()->getNodes();
-    for (NodeList::iterator it = nl->begin(); it != nl->end(); it++){
-      (*it)->value_ = ttItem_->value_;
-    //(*it)->visits_ = visits_;
+}
 
-    //this makes sense only in parallel mode
-    //(*it)->masterValue_ = masterValue_;
-    //(*it)->masterVisits_ = masterVisits_;
-   } 
-  }
+//---------------------------------------------------------------------
+
+TWstep& TWsteps::operator[](const Step& step)
+{ 
+  return table_[index(step)];
 }
 
 //---------------------------------------------------------------------
 
-void Node::update(float sample)
+void TWsteps::clear()
 {
-  float old_value = value_;
-  if (cfg.uctRelativeUpdate() && isMature()){
-    float weight = min(max(sqrt(visits_), 1.0), 10.0);
-    float added = ((sample - value_) * weight)/(visits_ + weight);
-    visits_ += 1;
-    value_ += added;
-  }else{
-    value_ += (sample - value_)/++visits_;         
+  for (uint i = 0; i < TWSTEPS_SIZE; i++){
+    table_[i].reset();
   }
-  squareSum_ += (sample - old_value) * (sample - value_);
-
-  //updating brothers comes after potential sync! 
-  updateTTbrothers(sample, 1);
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Node::updateTWstep(float sample)
+uint TWsteps::index(const Step& step)
 {
-  twStep_->value += (sample - twStep_->value) / ++(twStep_->visits);
+  assert(step.stepType_ <= STEP_NULL);
+  assert(IS_PLAYER(step.player_));
+
+  uint i = step.stepType_ * PLAYER_NUM + step.player_;
+  if (! step.pieceMoved()){
+    //pass/null
+    return i * 8 * SQUARE_NUM * 4;
+  }
+
+  int dir;
+  switch (step.to_ - step.from_){
+    case NORTH : dir = 0; break;
+    case SOUTH : dir = 1; break;
+    case EAST  : dir = 2; break;
+    default    : assert(step.to_ - step.from_ == WEST); dir = 3; break;
+  }
+  return ((i * 8 + step.piece_) * SQUARE_NUM + step.from_) * 4 + dir;
 }
 
+//---------------------------------------------------------------------
+// section PendingSteps
 //---------------------------------------------------------------------
 
-bool Node::isMature() const
+PendingSteps::PendingSteps()
 {
-  return visits_ >= cfg.matureLevel() + getDepth();
+  assert(false);
 }
 
 //--------------------------------------------------------------------- 
 
-bool Node::hasChildren() const
+PendingSteps::PendingSteps(const Step* steps, const float* heurs, uint len, 
+                           uint childrenNum, float baseVisits)
 {
-  return firstChild_ != NULL;
+  steps_ = new Step[len];
+  heurs_ = new float[len];
+  for (uint i = 0; i < len; i++){
+    steps_[i] = steps[i];
+    heurs_[i] = heurs[i];
+  }
+  len_ = len;
+  next_ = 0;
+  childrenNum_ = childrenNum;
+  baseVisits_ = max(baseVisits, 1.0f);
+  updateThreshold();
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Node::getFather() const
+PendingSteps::~PendingSteps()
 {
-  return father_;
+  delete [] steps_;
+  delete [] heurs_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Node::setFather(Node* father)
+PendingSteps* PendingSteps::clone() const
 {
-  father_ = father;
+  return new PendingSteps(steps_ + next_, heurs_ + next_, len_ - next_, 
+                          childrenNum_, baseVisits_);
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Node::getFirstChild() const
+bool PendingSteps::hasNext() const
 {
-  return firstChild_;
+  return next_ < len_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Node::getSibling() const
+Step PendingSteps::popNext(float & heur)
 {
-  return sibling_;
+  assert(hasNext());
+  childrenNum_++;
+  updateThreshold();
+  heur = heurs_[next_];
+  return steps_[next_++];
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Node::setSibling(Node* node) 
-{ 
-  sibling_ = node; 
+float PendingSteps::getThreshold() const
+{
+  return threshold_;
 }
 
 //--------------------------------------------------------------------- 
 
-TTitem* Node::getTTitem() const
+void PendingSteps::updateThreshold()
 {
-  return ttItem_;
+  //inverse of children = init * (visits / base)^exponent
+  threshold_ = baseVisits_ * pow(float(childrenNum_ + 1) / cfg.pwInitChildren(), 
+                                 1 / cfg.pwExponent());
 }
 
 //---------------------------------------------------------------------
-
-void Node::setTTitem(TTitem* item) 
-{ 
-  ttItem_ = item;
-}
-
+// section SnapshotCache
 //---------------------------------------------------------------------
 
-void Node::setFirstChild(Node* node) 
-{ 
-  firstChild_ = node; 
+SnapshotCache::SnapshotCache()
+{
+  assert(false);
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Step Node::getStep() const
+SnapshotCache::SnapshotCache(uint size)
 {
-  assert(twStep_);
-  return twStep_->step;
+  assert(size > 0);
+  size_ = size;
+  nodes_ = new const Node*[size_];
+  visits_ = new int[size_];
+  boards_ = new Board[size_];
+  clear();
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-TWstep* Node::getTWstep() const 
+SnapshotCache::~SnapshotCache()
 {
-  return twStep_; 
+  delete [] nodes_;
+  delete [] visits_;
+  delete [] boards_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-player_t Node::getPlayer() const
+const Board* SnapshotCache::load(const Node* node) const
 {
-  return getStep().getPlayer();
+  uint i = index(node);
+  return nodes_[i] == node ? &boards_[i] : NULL;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-int Node::getVisits() const
+void SnapshotCache::store(const Node* node, int visits, const Board* board)
 {
-  return visits_;
+  uint i = index(node);
+  if (nodes_[i] && visits_[i] > visits){
+    return;
+  }
+  nodes_[i] = node;
+  visits_[i] = visits;
+  boards_[i] = *board;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Node::setVisits(int visits) 
+void SnapshotCache::clear()
 {
-  visits_ = visits;
+  for (uint i = 0; i < size_; i++){
+    nodes_[i] = NULL;
+    visits_[i] = 0;
+  }
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-float Node::getValue() const
+uint SnapshotCache::index(const Node* node) const
 {
-  return value_;
+  //nodes are aligned - drop the low bits
+  return uint((unsigned long)(node) >> 4) % size_;
 }
 
+//---------------------------------------------------------------------
+// section TTitem
 //---------------------------------------------------------------------
 
-void Node::setValue(float value) 
-{
-  value_ = value;
+TTitem::TTitem() 
+{ 
+  assert(false);
 }
 
 //--------------------------------------------------------------------- 
 
-void Node::setMaster(Node* master)
+TTitem::TTitem(u64 signature, uint playerIndex, int depthIdentifier) 
 {
-  master_ = master;
+  visits_ = 0; 
+  value_ = 0; 
+  firstChild_ = NULL;
+  pendingSteps_ = NULL;
+  childrenVersion_ = 0;
+  refs_ = 0;
+  signature_ = signature;
+  playerIndex_ = playerIndex;
+  depthIdentifier_ = depthIdentifier;
 }
 
 //--------------------------------------------------------------------- 
 
-Node* Node::getMaster()
+u64 TTitem::getSignature() const
 {
-  return master_;
+  return signature_;
 }
 
 //--------------------------------------------------------------------- 
 
-void Node::lock()
+uint TTitem::getPlayerIndex() const
 {
-  pthread_mutex_lock(&mutex);
+  return playerIndex_;
 }
 
 //--------------------------------------------------------------------- 
 
-void Node::unlock()
+int TTitem::getDepthIdentifier() const
 {
-  pthread_mutex_unlock(&mutex);
+  return depthIdentifier_;
 }
 
 //--------------------------------------------------------------------- 
 
-nodeType_e Node::getNodeType() const
+int TTitem::getRefs() const
 {
-  return ( twStep_->step.getPlayer() == GOLD ? NODE_MAX : NODE_MIN );
+  return refs_;
 }
 
+//---------------------------------------------------------------------
+// section SharedTT
 //---------------------------------------------------------------------
 
-int Node::getDepth() const
+SharedTT::SharedTT(uint capacity)
 {
-  int depth = 0;
-  Node* node = this->father_;
-
-  while (node != NULL){
-    node = node->getFather();
-    depth++;
+  uint buckets = 1;
+  while (buckets * SHARED_TT_BUCKET < capacity){
+    buckets <<= 1;
+  }
+  table_ = new Entry[buckets * SHARED_TT_BUCKET];
+  memset((void*)table_, 0, buckets * SHARED_TT_BUCKET * sizeof(Entry));
+  mask_ = buckets - 1;
+  generation_ = 1;
+
+  playerSignature_[0] = getRandomU64();
+  playerSignature_[1] = getRandomU64(); 
+  for (int i = 0; i < MAX_LEVELS; i++){
+    levelSignature_[i] = getRandomU64();
   }
-  return depth;
 }
 
 //--------------------------------------------------------------------- 
 
-int Node::getLocalDepth() const
+SharedTT::~SharedTT()
 {
-  int depth = 0;
-  const Node* node = this;
-
-  while (node->father_ != NULL && node->getNodeType() == getNodeType()){
-    depth += max(1, node->getStep().count());
-    node = node->getFather();
-  }
-  return depth;
+  delete [] table_;
 }
 
 //--------------------------------------------------------------------- 
 
+void SharedTT::newSearch()
+{
+  generation_ = generation_ % 0xFF + 1;
+}
+
+//--------------------------------------------------------------------- 
 
-int Node::getLevel() const
+u64 SharedTT::getKey(u64 signature, uint playerIndex, int depthIdentifier) const
 {
-  Node * act = father_;
-  nodeType_e lastNodeType = getNodeType();
-  int level = 0;
+  assert(playerIndex == 0 || playerIndex == 1);
+  u64 key = signature ^ playerSignature_[playerIndex] ^ 
+            levelSignature_[depthIdentifier % MAX_LEVELS];
+  //lowest byte is for the generation
+  key &= ~u64(0xFF);
+  return key ? key : 0x100; 
+}
 
-  while (act != NULL){
-    if (act->getNodeType() != lastNodeType) {
-      level++;
-      lastNodeType = act->getNodeType();
-    }
-    act = act->father_;
+//--------------------------------------------------------------------- 
+
+bool SharedTT::load(u64 key, float& value, int& visits) const
+{
+  Entry* entry = find(&table_[((key >> 8) & mask_) * SHARED_TT_BUCKET], key | generation_);
+  if (! entry){
+    return false;
   }
-  return level;
+  Stats stats;
+  if (! unpack(entry->packed, key | generation_, stats)){
+    return false;
+  }
+  value = stats.value;
+  visits = stats.visits;
+  return visits > 0;
 }
 
 //--------------------------------------------------------------------- 
 
-int Node::getDepthIdentifier() const
+float SharedTT::update(u64 key, float sample, int count)
 {
-  return STEPS_IN_MOVE * getLevel() + getLocalDepth();
+  Entry* bucket = &table_[((key >> 8) & mask_) * SHARED_TT_BUCKET];
+  u64 tag = key | generation_;
+  Stats stats;
+
+  Entry* entry = find(bucket, tag);
+  if (entry){
+    u64 oldPacked;
+    do {
+      oldPacked = entry->packed;
+      //entry is just being replaced - sample starts the statistics
+      if (! unpack(oldPacked, tag, stats)){
+        stats.value = sample;
+        stats.visits = count;
+        continue;
+      }
+      stats.visits = min(stats.visits + count, SHARED_TT_MAX_VISITS);
+      stats.value += (sample - stats.value) * count / stats.visits;
+    } while (! __sync_bool_compare_and_swap(&entry->packed, oldPacked, pack(stats, tag)));
+    return stats.value;
+  }
+
+  //replace entry from old search or the least visited one 
+  Entry* victim = bucket;
+  for (int i = 0; i < SHARED_TT_BUCKET; i++){
+    if ((bucket[i].tag & 0xFF) != generation_){
+      victim = &bucket[i];
+      break;
+    }
+    if (packedVisits(bucket[i].packed) < packedVisits(victim->packed)){
+      victim = &bucket[i];
+    }
+  }
+  stats.value = sample;
+  stats.visits = min(count, SHARED_TT_MAX_VISITS);
+  victim->tag = tag;
+  victim->packed = pack(stats, tag);
+  return sample;
 }
 
 //--------------------------------------------------------------------- 
 
-string Node::toString() const
+SharedTT::Entry* SharedTT::find(Entry* bucket, u64 tag) const
 {
-  stringstream ss;
+  for (int i = 0; i < SHARED_TT_BUCKET; i++){
+    if (bucket[i].tag == tag){
+      return &bucket[i];
+    }
+  }
+  return NULL;
+}
 
-  ss << getStep().toString() << "(" << getDepthIdentifier() << " " <<  ( getNodeType()  == NODE_MAX ? "+" : "-" )  << ") " << 
-        value_ << "/" << visits_ << " twstep " << twStep_->value << "/" << twStep_->visits << " " << endl;
-  return ss.str();
+//---------------------------------------------------------------------
+
+u64 SharedTT::pack(const Stats& stats, u64 tag)
+{
+  assert(sizeof(float) == sizeof(uint));
+  uint valueBits;
+  memcpy(&valueBits, &stats.value, sizeof(valueBits));
+  assert(stats.visits >= 0 && stats.visits <= SHARED_TT_MAX_VISITS);
+  return ((tag >> (64 - SHARED_TT_CHECK_BITS)) << (32 + SHARED_TT_VISITS_BITS)) | 
+         (u64(stats.visits) << 32) | valueBits;
 }
 
 //---------------------------------------------------------------------
 
-string Node::recToString(int depth) const
+bool SharedTT::unpack(u64 packed, u64 tag, Stats& stats)
 {
-  const float print_visit_threshold_base    = 300;
-  const float print_visit_threshold_parent  = 0.05;
-  const int   print_max_brothers            = 3;
+  if ((packed >> (32 + SHARED_TT_VISITS_BITS)) != (tag >> (64 - SHARED_TT_CHECK_BITS))){
+    return false;
+  }
+  uint valueBits = uint(packed);
+  memcpy(&stats.value, &valueBits, sizeof(valueBits));
+  stats.visits = packedVisits(packed);
+  return true;
+}
 
-  float minVisitCount = print_visit_threshold_base + 
-                        visits_ * print_visit_threshold_parent; 
+//---------------------------------------------------------------------
+
+int SharedTT::packedVisits(u64 packed)
+{
+  return int((packed >> 32) & SHARED_TT_MAX_VISITS);
+}
+
+//---------------------------------------------------------------------
+// section Node
+//---------------------------------------------------------------------
+
+Node::Node()
+{
+  assert(false);
+}
+
+//---------------------------------------------------------------------
+
+Node::~Node()
+{
+  delete [] cCache_;
+  delete pendingSteps_;
+  if (! ttItem_){
+    return;
+  }
+
+  //the last node leading to the position deletes it
+  if (--ttItem_->refs_ == 0){
+    delete ttItem_->pendingSteps_;
+    delete ttItem_;
+  }
+}
+
+
+//---------------------------------------------------------------------
+
+Node::Node(const Step& step, TWstep* twStep, float heur)
+{
+  pthread_mutex_init(&mutex, NULL);
+  assert(IS_PLAYER(step.getPlayer()));
+  firstChild_ = NULL;
+  sibling_    = NULL;
+  father_     = NULL;  
+  visits_     = cfg.vv();
+  virtualLoss_ = 0;
+  value_      = 0; 
+  squareSum_  = 0;
+  heur_       = heur; 
+  step_       = step;
+  twStep_     = twStep;
+  ttItem_      = NULL;
+  sharedKey_  = 0;
+  pendingSteps_ = NULL;
+  proven_     = NO_PLAYER;
+  master_     = NULL;
+  //full cCache_ initialization in node::expand
+  cCache_     = NULL;
+  cCacheVersion_ = 0;
+  
+  masterValue_  = value_;
+  masterVisits_ = visits_;
+}
+
+//---------------------------------------------------------------------
+
+Node* Node::findUctChild(Node* realFather) 
+{
+  assert(hasChildren());
+  assert(realFather != NULL);
+  
+  Node* act = getFirstChild();
+  Node* best = act;
+  float bestUrgency = INT_MIN;   
+  
+  //dynamic exploreRate tuning 
+  float exploreRate = cfg.ucbTuned() ? 1 : 
+                                  (cfg.dynamicExploration() ? 
+                                  max(0.01, min(0.25, 3.5 * (double(squareSum_)/visits_)))
+                                  : cfg.exploreRate());
+  float exploreCoeff = exploreRate * log(realFather->visits_);
+
+  //children of the position changed through other node
+  if (ttItem_ && cCacheVersion_ != ttItem_->childrenVersion_){
+    cCacheLastUpdate_ = 0;
+    cCacheVersion_ = ttItem_->childrenVersion_;
+  }
+
+  if (cCache_ &&  visits_ > CCACHE_START_THRESHOLD){
+    //using children cache
+    assert(cCache_);
+    cCacheUpdate(exploreCoeff); 
+    for (int i = 0; i < CHILDREN_CACHE_SIZE && cCache_[i]; i++){
+      act = cCache_[i];   
+      uctOneChild(act, best, bestUrgency, exploreCoeff);
+    }
+  }else{
+    while (act != NULL) {
+      uctOneChild(act, best, bestUrgency, exploreCoeff);
+      act = act->sibling_;
+    }
+  }
+
+  return best;
+}
+
+//--------------------------------------------------------------------- 
+
+Node* Node::findRandomChild() const
+{
+  Node* node = getFirstChild();
+  assert(node != NULL);
+  int childNum = 0; 
+
+  //count children
+  while (node != NULL) {
+    node = node->sibling_;
+    childNum++; 
+  }    
+
+  //select children to be played  
+  childNum = random() % childNum;
+
+  node = getFirstChild();
+  for (int i=0; i < childNum; i++){
+    assert(node != NULL);
+    node = node->sibling_;
+  }
+  return node; 
+}
+
+//---------------------------------------------------------------------
+
+Node* Node::findMostExploredChild() const
+{
+  assert(hasChildren());
+
+  Node* best = getFirstChild();
+  Node* act = best;
+  while (act != NULL) {
+    if ( act->visits_ > best->visits_ )
+      best = act;
+    act = act->sibling_;
+  }
+  return best;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::cCacheInit(){
+  //tt brother's children might have been pruned under the node's old cache
+  if (! cCache_){
+    cCache_ = new Node*[CHILDREN_CACHE_SIZE];
+  }
+  assert(cCache_);
+  for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
+    cCache_[i] = NULL;
+  }
+  cCacheLastUpdate_ = 0;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::cCacheUpdate(float exploreCoeff)
+{
+  if (floor(sqrt(visits_)) <= cCacheLastUpdate_)
+    return;
+
+  cCacheLastUpdate_ = int(floor(sqrt(visits_)));
+  
+  //empty cache
+  for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
+    cCache_[i] = NULL;
+  }
+
+  Node * act = getFirstChild();
+  float actUrgency = 0;
+
+  float urgencies[CHILDREN_CACHE_SIZE];
+
+  //fill cache
+  while (act != NULL) {
+    if (act->isProven()){
+      act = act->sibling_;
+      continue;
+    }
+    actUrgency = act->exploreFormula(exploreCoeff);
+    for (int i = 0; i < CHILDREN_CACHE_SIZE; i++){ 
+      if (! cCache_[i] || 
+          urgencies[i] < actUrgency ){
+        //bubbling
+        for (int j = CHILDREN_CACHE_SIZE - 1; j > i ;j--){ 
+          cCache_[j] = cCache_[j - 1]; 
+          urgencies[j] = urgencies[j - 1];
+        }
+        cCache_[i] = act;
+        urgencies[i] = actUrgency;
+        break;
+      }
+    }
+    act = act->sibling_;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::cCacheInvalidate()
+{
+  cCacheLastUpdate_ = 0;
+  //caches of other nodes leading to the position
+  if (ttItem_){
+    ttItem_->childrenVersion_++;
+    cCacheVersion_ = ttItem_->childrenVersion_;
+  }
+}
+
+//---------------------------------------------------------------------
+
+void Node::uctOneChild(Node* act, Node* & best, float & bestUrgency, float exploreCoeff) const
+{
+  if (act->getMaster() && glob.grand()->get01() < 0.1){
+    act->syncMaster();
+  }
+
+  assert(act);
+  //result is known already
+  if (act->isProven()){
+    return;
+  }
+  float actUrgency = act->exploreFormula(exploreCoeff);
+
+  if ( actUrgency > bestUrgency ){
+    best = act;
+    bestUrgency = actUrgency;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+float Node::exploreFormula(float exploreCoeff) const
+{
+  //virtual loss counts as lost simulations for player in the node
+  int virtualLoss = virtualLoss_;
+  int visits = visits_ + virtualLoss;
+  if (visits == 0)
+    return FPU;
+  float value = virtualLoss ? 
+    (getValue() * visits_ + virtualLoss * (getNodeType() == NODE_MAX ? -1 : 1)) / visits : getValue();
+
+ return (cfg.ucbTuned() ? ucbTuned(exploreCoeff, value, visits) : ucb(exploreCoeff, value, visits))
+        + heur_/visits
+        + (cfg.historyHeuristic() ? ((getNodeType() == NODE_MAX ? twStep_->getValue() : - twStep_->getValue()) * 1.1 /mysqrt(visits)) : 0)
+        ;
+}
+
+//---------------------------------------------------------------------
+
+float Node::ucb(float exploreCoeff, float value, int visits) const
+{
+  return (getNodeType() == NODE_MAX ? value : - value) 
+         + sqrt(exploreCoeff)/mysqrt(visits);
+}
+
+//---------------------------------------------------------------------
+
+float Node::ucbTuned(float exploreCoeff, float value, int visits) const
+{
+  double v = max(0.01, min(0.25, 2 * double(squareSum_)/visits + 0.2 * sqrt(exploreCoeff/visits)));
+
+  return (getNodeType() == NODE_MAX ? value : - value) 
+         + sqrt(v * exploreCoeff)/mysqrt(visits);
+}
+
+//---------------------------------------------------------------------
+
+void Node::addChild(Node* newChild)
+{
+  assert(newChild->sibling_ == NULL);
+  assert(newChild->firstChild_ == NULL);
+  
+  newChild->sibling_ = getFirstChild();
+  setFirstChild(newChild);
+  newChild->father_ = this;
+  //obsolete, now using connectChildrenToMaster
+  //newChild->connectToMaster();
+}
+
+//--------------------------------------------------------------------- 
+
+bool Node::publishChildren(Node* head)
+{
+  Node** firstChild = ttItem_ ? &ttItem_->firstChild_ : &firstChild_;
+  return __sync_bool_compare_and_swap(firstChild, (Node*)NULL, head);
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::addVirtualLoss()
+{
+  __sync_fetch_and_add(&virtualLoss_, 1);
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::removeVirtualLoss()
+{
+  __sync_fetch_and_sub(&virtualLoss_, 1);
+}
+
+//--------------------------------------------------------------------- 
+ 
+void Node::reverseChildren()
+{
+  Node* act = getFirstChild();
+  Node* head = NULL;
+  while (act != NULL){
+    Node* next = act->sibling_;
+    act->sibling_ = head;
+    head = act;
+    act = next;
+  }
+  setFirstChild(head);
+}
+
+//---------------------------------------------------------------------
+
+void Node::delChildrenRec()
+{
+  //somebody else will take care
+  if (getTTitem() && getTTitem()->getRefs() > 1) {
+    return;
+  }
+
+  Node* actNode = getFirstChild();
+  Node* sibling;
+  while(actNode != NULL){
+    sibling = actNode->sibling_;
+    actNode->delChildrenRec();
+    delete actNode;
+    actNode = sibling;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::clearChildren()
+{
+  setFirstChild(NULL);
+  setPendingSteps(NULL);
+  delete [] cCache_;
+  cCache_ = NULL;
+  if (ttItem_){
+    ttItem_->childrenVersion_++;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+int Node::connectToMaster(const bool lock)
+{
+  if ((! getFather()) || (! getFather()->getMaster())){
+    return 0;
+  }
+
+  Node* masterFather = getFather()->getMaster(); 
+  if (lock){
+    masterFather->lock();
+  }
+  Node* child = masterFather->getFirstChild();
+
+  while (child != NULL){
+    if (child->getStep() == getStep()){
+      //add link only
+      setMaster(child);
+      if (lock){
+        masterFather->unlock();
+      }
+      return 0;
+    }
+    child = child->getSibling();
+  }
+
+  //if not found - create node and add to the master father
+  child = new Node(step_, twStep_, 0);  
+  masterFather->addChild(child);
+  setMaster(child);
+  if (lock){
+    masterFather->unlock();
+  }
+  return 1;
+}
+
+//--------------------------------------------------------------------- 
+
+int Node::connectChildrenToMaster()
+{
+  if (! master_){
+    return 0;
+  }
+  
+  int created = 0;
+  master_->lock();
+  Node* mChild = master_->getFirstChild();
+  Node* child = getFirstChild();
+
+  bool addMode = mChild ? false : true;
+
+  while (child != NULL){
+    if (addMode){
+      //add node 
+      //TODO remove the bind to local twStep
+      Node* mChildNew = new Node(child->getStep(), child->getTWstep(), 0);  
+      master_->addChild(mChildNew);
+      child->setMaster(mChildNew);
+      created++;
+    }else{
+      //connect only
+      if (mChild && mChild->getStep() == child->getStep()){
+        child->setMaster(mChild);
+        mChild = mChild->getSibling();
+      }else{
+        //this shouldn't happen but it MIGHT - for instance because of tt discrepancies
+        //use lockless connection to master(father already locked)
+        created += child->connectToMaster(false);
+      }
+    }
+    child = child->getSibling();
+  }
+  
+  if (addMode){
+    //small hack to have the same ordering in the master and slave trees
+    master_->reverseChildren();
+  }
+
+  master_->unlock();
+  return created;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::syncMaster()
+{
+  assert(master_);
+  master_->lock();
+  float mCombined  = master_->getValue() * master_->getVisits();
+  float mOldCombined  = masterValue_ * masterVisits_; 
+  float combined = getValue() * visits_;
+  int newVisits = visits_ + master_->getVisits() - masterVisits_;
+  float newValue = (combined + mCombined - mOldCombined) / newVisits;
+  master_->setVisits(newVisits);
+  master_->setValue(newValue);
+  master_->unlock();
+
+  assert(newVisits >= visits_);
+
+  /*
+  float twStepCombined = twStep_->visits * twStep_->value;
+  twStep_->visits = twStep_->visits + newVisits - visits_;
+  twStep_->value = 
+    (twStepCombined + newVisits * newValue - combined)/twStep_->visits;
+  */
+
+  setValue(newValue);
+  visits_= newVisits;
+  masterValue_ = newValue;
+  masterVisits_= newVisits;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::recSyncMaster()
+{
+  if (! master_){
+    return;
+  }
+    
+  syncMaster();
+
+  Node* child = getFirstChild();
+  while(child != NULL){
+    child->recSyncMaster();
+    child = child->getSibling();
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::updateTTitem(float sample, int size, bool concurrent)
+{
+  //nodes leading to the position read the value from the item
+  if (! ttItem_ || ! size) {
+    return;
+  }
+  if (concurrent){
+    int visits = __sync_add_and_fetch(&ttItem_->visits_, size);
+    int oldBits, newBits;
+    float oldValue, newValue;
+    do {
+      oldValue = ttItem_->value_;
+      newValue = oldValue + (sample - oldValue * size) / visits;
+      memcpy(&oldBits, &oldValue, sizeof(oldBits));
+      memcpy(&newBits, &newValue, sizeof(newBits));
+    } while (! __sync_bool_compare_and_swap((int*)&ttItem_->value_, oldBits, newBits));
+    return;
+  }
+  ttItem_->value_ = 
+    (ttItem_->value_ * ttItem_->visits_ + sample)/(ttItem_->visits_ + size);
+  ttItem_->visits_ += size;
+}
+
+//---------------------------------------------------------------------
+
+void Node::update(float sample, int count, bool concurrent)
+{
+  float old_value = value_;
+  if (concurrent){
+    //other threads might update the node concurrently
+    int visits = __sync_add_and_fetch(&visits_, count);
+    int oldBits, newBits;
+    float newValue;
+    do {
+      old_value = value_;
+      newValue = old_value + (sample - old_value) * count / visits;
+      memcpy(&oldBits, &old_value, sizeof(oldBits));
+      memcpy(&newBits, &newValue, sizeof(newBits));
+    } while (! __sync_bool_compare_and_swap((int*)&value_, oldBits, newBits));
+    //variance is approximate only (not needed to be exact) 
+    squareSum_ += (sample - old_value) * (sample - newValue);
+    //value of the position is read from the item (if any)
+    updateTTitem(sample * count, count, true);
+    return;
+  }
+
+  if (cfg.uctRelativeUpdate() && isMature()){
+    float weight = min(max(sqrt(visits_), 1.0), 10.0) * count;
+    float added = ((sample - value_) * weight)/(visits_ + weight);
+    visits_ += count;
+    value_ += added;
+  }else{
+    visits_ += count;
+    value_ += (sample - value_) * count / visits_;         
+  }
+  squareSum_ += (sample - old_value) * (sample - value_) * count;
+
+  //updating the position comes after potential sync! 
+  updateTTitem(sample * count, count);
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::updateTWstep(float sample, int count)
+{
+  twStep_->update(sample, count);
+}
+
+//---------------------------------------------------------------------
+
+bool Node::canWiden() const
+{
+  PendingSteps* pendingSteps = getPendingSteps();
+  return pendingSteps && pendingSteps->hasNext() && 
+         visits_ >= pendingSteps->getThreshold();
+}
+
+//---------------------------------------------------------------------
+
+bool Node::isMature() const
+{
+  return visits_ >= cfg.matureLevel() + getDepth();
+}
+
+//--------------------------------------------------------------------- 
+
+bool Node::hasChildren() const
+{
+  return getFirstChild() != NULL;
+}
+
+//---------------------------------------------------------------------
+
+Node* Node::getFather() const
+{
+  return father_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setFather(Node* father)
+{
+  father_ = father;
+}
+
+//---------------------------------------------------------------------
+
+Node* Node::getFirstChild() const
+{
+  return ttItem_ ? ttItem_->firstChild_ : firstChild_;
+}
+
+//---------------------------------------------------------------------
+
+Node* Node::getSibling() const
+{
+  return sibling_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setSibling(Node* node) 
+{ 
+  sibling_ = node; 
+}
+
+//--------------------------------------------------------------------- 
+
+TTitem* Node::getTTitem() const
+{
+  return ttItem_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setTTitem(TTitem* item) 
+{ 
+  assert(! ttItem_);
+  ttItem_ = item;
+  ttItem_->refs_++;
+}
+
+//---------------------------------------------------------------------
+
+u64 Node::getSharedKey() const
+{
+  return sharedKey_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setSharedKey(u64 key) 
+{ 
+  sharedKey_ = key;
+}
+
+//---------------------------------------------------------------------
+
+PendingSteps* Node::getPendingSteps() const
+{
+  return ttItem_ ? ttItem_->pendingSteps_ : pendingSteps_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setPendingSteps(PendingSteps* pendingSteps) 
+{ 
+  if (ttItem_){
+    ttItem_->pendingSteps_ = pendingSteps;
+    return;
+  }
+  pendingSteps_ = pendingSteps;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setFirstChild(Node* node) 
+{ 
+  if (ttItem_){
+    ttItem_->firstChild_ = node;
+    return;
+  }
+  firstChild_ = node; 
+}
+
+//---------------------------------------------------------------------
+
+Step Node::getStep() const
+{
+  return step_;
+}
+
+//---------------------------------------------------------------------
+
+TWstep* Node::getTWstep() const 
+{
+  return twStep_; 
+}
+
+//---------------------------------------------------------------------
+
+player_t Node::getPlayer() const
+{
+  return getStep().getPlayer();
+}
+
+//---------------------------------------------------------------------
+
+int Node::getVisits() const
+{
+  return visits_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setVisits(int visits) 
+{
+  visits_ = visits;
+}
+
+//---------------------------------------------------------------------
+
+float Node::getValue() const
+{
+  //value of the position is shared by all nodes leading to it
+  return ttItem_ ? ttItem_->value_ : value_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setValue(float value) 
+{
+  value_ = value;
+  //value is read from the item
+  if (ttItem_){
+    ttItem_->value_ = value;
+  }
+}
+
+//---------------------------------------------------------------------
+
+float Node::getHeur() const
+{
+  return heur_;
+}
+
+//---------------------------------------------------------------------
+
+void Node::setHeur(float heur) 
+{
+  heur_ = heur;
+}
+
+//--------------------------------------------------------------------- 
+
+player_t Node::getProven() const
+{
+  return proven_;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::setProven(player_t winner) 
+{
+  proven_ = winner;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Node::isProven() const
+{
+  return proven_ != NO_PLAYER;
+}
+
+//---------------------------------------------------------------------
+
+void Node::copyStatistics(const Node* node) 
+{
+  value_ = node->getValue();
+  visits_ = node->visits_;
+  squareSum_ = node->squareSum_;
+  masterValue_ = value_;
+  masterVisits_ = visits_;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::copyTTitemStatistics(const Node* node) 
+{
+  assert(ttItem_ && node->ttItem_);
+  ttItem_->value_ = node->ttItem_->value_;
+  ttItem_->visits_ = node->ttItem_->visits_;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::setMaster(Node* master)
+{
+  master_ = master;
+}
+
+//--------------------------------------------------------------------- 
+
+Node* Node::getMaster()
+{
+  return master_;
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::lock()
+{
+  pthread_mutex_lock(&mutex);
+}
+
+//--------------------------------------------------------------------- 
+
+void Node::unlock()
+{
+  pthread_mutex_unlock(&mutex);
+}
+
+//--------------------------------------------------------------------- 
+
+nodeType_e Node::getNodeType() const
+{
+  return ( step_.getPlayer() == GOLD ? NODE_MAX : NODE_MIN );
+}
+
+//---------------------------------------------------------------------
+
+int Node::getDepth() const
+{
+  int depth = 0;
+  Node* node = this->father_;
+
+  while (node != NULL){
+    node = node->getFather();
+    depth++;
+  }
+  return depth;
+}
+
+//--------------------------------------------------------------------- 
+
+int Node::getLocalDepth() const
+{
+  int depth = 0;
+  const Node* node = this;
+
+  while (node->father_ != NULL && node->getNodeType() == getNodeType()){
+    depth += max(1, node->getStep().count());
+    node = node->getFather();
+  }
+  return depth;
+}
+
+//--------------------------------------------------------------------- 
+
+
+int Node::getLevel() const
+{
+  Node * act = father_;
+  nodeType_e lastNodeType = getNodeType();
+  int level = 0;
+
+  while (act != NULL){
+    if (act->getNodeType() != lastNodeType) {
+      level++;
+      lastNodeType = act->getNodeType();
+    }
+    act = act->father_;
+  }
+  return level;
+}
+
+//--------------------------------------------------------------------- 
+
+int Node::getDepthIdentifier() const
+{
+  return STEPS_IN_MOVE * getLevel() + getLocalDepth();
+}
+
+//--------------------------------------------------------------------- 
+
+string Node::toString() const
+{
+  stringstream ss;
+
+  ss << getStep().toString() << "(" << getDepthIdentifier() << " " <<  ( getNodeType()  == NODE_MAX ? "+" : "-" )  << ") " << 
+        value_ << "/" << visits_ << " twstep " << twStep_->getValue() << "/" << twStep_->getVisits() << " " << endl;
+  return ss.str();
+}
+
+//---------------------------------------------------------------------
+
+string Node::recToString(int depth) const
+{
+  const float print_visit_threshold_base    = 300;
+  const float print_visit_threshold_parent  = 0.05;
+  const int   print_max_brothers            = 3;
+
+  float minVisitCount = print_visit_threshold_base + 
+                        visits_ * print_visit_threshold_parent; 
   //minVisitCount = 0;
   stringstream ss; 
   for (int i = 0; i < depth; i++ )
     ss << "   ";
   ss << toString();
 
-  Node* best = NULL; 
+  Node* best = NULL; 
+
+  typedef set<Node* > nodeTab;
+  nodeTab tab;
+  
+  Node* actNode = getFirstChild();
+  while(actNode != NULL){
+    if ((actNode->visits_) >= minVisitCount){
+      tab.insert(actNode); 
+    }
+    actNode = actNode->sibling_;
+  }
+  
+  int printed = 0;
+  while (true){
+    for (nodeTab::iterator it = tab.begin(); it != tab.end(); it++){
+      if(! best || ((*it)->visits_ > best->visits_)){
+          best = (*it);
+      }
+    }
+    if (best){
+        ss << best->recToString(depth + 1);
+        tab.erase(best);
+        best = NULL;
+    }else{
+      break;
+    }
+    if (++printed >= print_max_brothers) {
+      break;
+    }
+  }
+  return ss.str();
+}
+
+//---------------------------------------------------------------------
+//  section Tree
+//---------------------------------------------------------------------
+
+Tree::Tree(Node* root)
+{
+  assert(root->getFather() == NULL);
+  init();
+  history[0] = root; 
+}
+
+//--------------------------------------------------------------------- 
+
+Tree::Tree(player_t firstPlayer, TWsteps* twSteps, SharedTT* sharedTT)
+{
+  init(twSteps, false, sharedTT);
+  Step step(STEP_NULL, firstPlayer);
+  history[historyTop] = new Node(step, &((*twSteps_)[step]), 0);
+  nodesNum_ = 1;
+}
+
+//--------------------------------------------------------------------- 
+
+Tree::Tree(Tree* sharedTree)
+{
+  init(sharedTree->twSteps_, true);
+  history[0] = sharedTree->root(); 
+  masterTree_ = sharedTree;
+}
+
+//--------------------------------------------------------------------- 
+
+Tree::Tree(const Tree* tree, const Node* node, const Board* board)
+{
+  init();
+  //history heuristic is valid for the position as well
+  *twSteps_ = *tree->twSteps_;
+
+  Step step(STEP_NULL, board->getPlayerToMove());
+  history[0] = new Node(step, &((*twSteps_)[step]), 0);
+  history[0]->copyStatistics(node);
+  nodesNum_ = 1;
+
+  copyChildren(history[0], node, board, true);
+}
+
+//--------------------------------------------------------------------- 
+
+Tree::~Tree()
+{
+  //nodes of the shared tree are deleted by the owner
+  if (! shared_){
+    history[0]->delChildrenRec();
+    delete history[0];
+  }
+  if (tt_){
+    releaseTT(tt_);
+  }
+  delete snapshots_;
+  if (ownTWsteps_){
+    delete twSteps_;
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::syncMaster(){
+  root()->recSyncMaster();
+}
+
+//--------------------------------------------------------------------- 
+
+bool Tree::isShared() const
+{
+  return shared_;
+}
+
+//--------------------------------------------------------------------- 
+
+const Node* Tree::findPosition(const Board* rootBoard, const Board* board, 
+                               int maxMoves, int minVisits) const
+{
+  if (rootBoard->getSignature() == board->getSignature() && 
+      rootBoard->getPlayerToMove() == board->getPlayerToMove() && 
+      rootBoard->getStepCount() == board->getStepCount()){
+    return history[0];
+  }
+  if (maxMoves <= 0 || board->getStepCount() != 0){
+    return NULL;
+  }
+  return findPositionRec(history[0], rootBoard, board, maxMoves, minVisits);
+}
+
+//--------------------------------------------------------------------- 
+
+const Node* Tree::findPositionRec(const Node* node, const Board* nodeBoard, const Board* board, 
+                                  int movesLeft, int minVisits) const
+{
+  const Node* best = NULL;
+  Node* child = node->getFirstChild();
+  while (child != NULL){
+    if (child->getVisits() >= minVisits && ! child->getStep().isNull()){
+      const Node* found = NULL;
+      Board* childBoard = new Board(*nodeBoard);
+      if (! childBoard->makeStepTryCommit(child->getStep())){
+        found = findPositionRec(child, childBoard, board, movesLeft, minVisits);
+      }
+      else if (childBoard->getWinner() == NO_PLAYER){
+        if (childBoard->getSignature() == board->getSignature() && 
+            childBoard->getPlayerToMove() == board->getPlayerToMove()){
+          found = child;
+        }
+        else if (movesLeft > 1){
+          found = findPositionRec(child, childBoard, board, movesLeft - 1, minVisits);
+        }
+      }
+      delete childBoard;
+      if (found && (! best || found->getVisits() > best->getVisits())){
+        best = found;
+      }
+    }
+    child = child->getSibling();
+  }
+  return best;
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::copyChildren(Node* copy, const Node* node, const Board* board, bool firstMove)
+{
+  //children of the position were copied under its tt brother 
+  if (copy->hasChildren()){
+    if (cfg.childrenCache()){
+      copy->cCacheInit();
+    }
+    return;
+  }
+  Node* child = node->getFirstChild();
+  if (child == NULL){
+    return;
+  }
+
+  //game history changed since the expansion 
+  StepArray steps;
+  int stepsNum = 0;
+  if (firstMove){
+    for (Node* act = child; act != NULL; act = act->getSibling()){
+      steps[stepsNum++] = act->getStep();
+    }
+    stepsNum = board->filterRepetitions(steps, stepsNum);
+  }
+
+  Node* last = NULL;
+  for (; child != NULL; child = child->getSibling()){
+    bool allowed = ! firstMove;
+    for (int i = 0; i < stepsNum && ! allowed; i++){
+      allowed = steps[i] == child->getStep();
+    }
+    if (! allowed){
+      continue;
+    }
+    Node* newChild = new Node(child->getStep(), &((*twSteps_)[child->getStep()]), child->getHeur());
+    newChild->copyStatistics(child);
+    newChild->setFather(copy);
+    //order of children is kept
+    if (last){
+      last->setSibling(newChild);
+    }
+    else{
+      copy->setFirstChild(newChild);
+    }
+    last = newChild;
+    nodesNum_++;
+
+    //new item takes the statistics of the old one (all edges leading to the position)
+    if (useTT()){
+      updateTTnode(newChild, board);
+      if (child->getTTitem() && newChild->getTTitem() && newChild->getTTitem()->getRefs() == 1){
+        newChild->copyTTitemStatistics(child);
+      }
+    }
+
+    //board is needed by the tt and by the repetitions filter (first move)
+    Board* childBoard = NULL;
+    bool moveOver = true;
+    if (useTT() || firstMove){
+      childBoard = new Board(*board);
+      moveOver = childBoard->makeStepTryCommit(child->getStep());
+    }
+    copyChildren(newChild, child, childBoard, firstMove && ! moveOver);
+    delete childBoard;
+  }
+
+  if (! copy->hasChildren()){
+    return;
+  }
+  if (node->getPendingSteps()){
+    copy->setPendingSteps(node->getPendingSteps()->clone());
+  }
+  if (cfg.childrenCache()){
+    copy->cCacheInit();
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+bool Tree::useTT() const
+{
+  return cfg.uct_tt() && ! shared_;
+}
+
+//--------------------------------------------------------------------- 
+
+bool Tree::useSharedTT() const
+{
+  return sharedTT_ != NULL;
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::expandNode(Node* node, const StepArray& steps, uint len, const HeurArray* heurs)
+{
+  Node* newChild;
+  assert(len);
+  assert(node);
+  assert(steps[0].getPlayer() == steps[len-1].getPlayer());
+
+  uint created = len;
+  Node* head = NULL;
+  PendingSteps* pendingSteps = NULL;
+  //heuristics might order the widening only (they don't bias the descent then)
+  bool knowledge = heurs && cfg.knowledgeInTree();
+  //children are linked privately and published at once
+  if (cfg.progressiveWidening() && ! shared_ && len > uint(cfg.pwInitChildren())){
+    //order steps by heuristics (best first) 
+    Step ordered[MAX_STEPS];
+    float orderedHeurs[MAX_STEPS];
+    for (uint i = 0; i < len; i++){
+      uint j = i;
+      float heur = heurs ? (*heurs)[i] : 0;
+      //stable insertion - steps with same heuristic keep generation order
+      while (j > 0 && orderedHeurs[j - 1] < heur){
+        ordered[j] = ordered[j - 1];
+        orderedHeurs[j] = orderedHeurs[j - 1];
+        j--;
+      }
+      ordered[j] = steps[i];
+      orderedHeurs[j] = heur;
+    }
+    if (! knowledge){
+      for (uint i = 0; i < len; i++){
+        orderedHeurs[i] = 0;
+      }
+    }
+
+    created = cfg.pwInitChildren();
+    for (uint i = 0; i < created; i++){
+      newChild = new Node(ordered[i], &((*twSteps_)[ordered[i]]), orderedHeurs[i]);  
+      newChild->setFather(node);
+      newChild->setSibling(head);
+      head = newChild;
+    }
+    pendingSteps = new PendingSteps(ordered + created, orderedHeurs + created, 
+                                    len - created, created, node->getVisits());
+  }
+  else {
+    for (uint i = 0; i < len; i++){
+      newChild = new Node(steps[i], &((*twSteps_)[steps[i]]), knowledge ? (*heurs)[i] : 0);  
+      newChild->setFather(node);
+      newChild->setSibling(head);
+      head = newChild;
+    }
+  }
+
+  if (! node->publishChildren(head)){
+    //other thread expanded the node meanwhile (shared tree)
+    while (head != NULL){
+      newChild = head->getSibling();
+      delete head;
+      head = newChild;
+    }
+    return;
+  }
+  node->setPendingSteps(pendingSteps);
+  addNodes(created);
+  nodesExpandedNum_++;
+
+  //ccache init
+  if (cfg.childrenCache() && ! shared_){
+    node->cCacheInit();
+  }
+
+  addMasterNodes(node->connectChildrenToMaster());
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::widenNode(Node* node, const Board* board)
+{
+  assert(node->canWiden());
+  float heur;
+  Step step = node->getPendingSteps()->popNext(heur);
+  Node* newChild = new Node(step, &((*twSteps_)[step]), heur);
+  node->addChild(newChild);
+  addNodes(1);
+
+  //caches of all nodes leading to the position are refreshed
+  node->cCacheInvalidate();
+  addMasterNodes(newChild->connectToMaster());
+
+  if (useTT()){
+    updateTTnode(newChild, board);
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::expandNodeLimited(Node* node, const Move& move)
+{
+  Node* newChild;
+  Node* first = NULL;
+  Node* last = NULL;
+  StepList stepList = move.getStepList();
+  assert(! stepList.empty());
+  assert(node);
+  //the chain is built privately and published at once
+  for (StepListIter it = stepList.begin(); it != stepList.end(); it++){
+    newChild = new Node(*it, &(*twSteps_)[*it]);
+    if (last){
+      last->addChild(newChild);
+    }else{
+      newChild->setFather(node);
+      first = newChild;
+    }
+    last = newChild;
+  }
+
+  if (! node->publishChildren(first)){
+    //other thread expanded the node meanwhile (shared tree)
+    first->delChildrenRec();
+    delete first;
+    return;
+  }
+
+  for (newChild = first; newChild != NULL; newChild = newChild->getFirstChild()){
+    //for parallel mode(otherwise the nodes would not be in the master tree)
+    addMasterNodes(newChild->connectToMaster());
+    addNodes(1);
+    nodesExpandedNum_++;
+  }
+}
 
-  typedef set<Node* > nodeTab;
-  nodeTab tab;
-  
-  Node* actNode = firstChild_;
-  while(actNode != NULL){
-    if ((actNode->visits_) >= minVisitCount){
-      tab.insert(actNode); 
+//---------------------------------------------------------------------
+
+void Tree::uctDescend()
+{
+  assert(actNode()->hasChildren());
+  historyPush(actNode()->findUctChild(history[historyTop]));
+}
+
+//---------------------------------------------------------------------
+
+void Tree::randomDescend()
+{
+  assert(actNode()->hasChildren());
+  historyPush(actNode()->findRandomChild());
+}
+
+//---------------------------------------------------------------------
+
+void Tree::firstChildDescend()
+{
+  assert(actNode()->hasChildren());
+  historyPush(actNode()->getFirstChild());
+}
+
+//---------------------------------------------------------------------
+
+Node* Tree::findBestMoveNode(Node* subTreeRoot)
+{
+  Node* act = subTreeRoot; 
+  player_t player = subTreeRoot->getPlayer();
+
+  //proven win is played directly
+  if (subTreeRoot->getProven() == player){
+    while (act->hasChildren() && act->getFirstChild()->getPlayer() == player){
+      Node* child = act->getFirstChild();
+      while (child != NULL && child->getProven() != player){
+        child = child->getSibling();
+      }
+      if (child == NULL){
+        break;
+      }
+      act = child;
+    }
+    if (act != subTreeRoot){
+      return act;
     }
-    actNode = actNode->sibling_;
   }
-  
-  int printed = 0;
+
   while (true){
-    for (nodeTab::iterator it = tab.begin(); it != tab.end(); it++){
-      if(! best || ((*it)->visits_ > best->visits_)){
-          best = (*it);
-      }
-    }
-    if (best){
-        ss << best->recToString(depth + 1);
-        tab.erase(best);
-        best = NULL;
-    }else{
+    if (! act->hasChildren() || 
+          (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
       break;
     }
-    if (++printed >= print_max_brothers) {
-      break;
+    act = act->findMostExploredChild();
+  }
+
+  //Now we have some good solution - DFS in the 
+  //first layer of the tree follows (proven losses are avoided)
+  Node * solution = act;
+  Node * best = act->getProven() == OPP(player) ? NULL : act;
+  list<Node *> stack;
+  stack.clear();
+  stack.push_back(subTreeRoot);
+  while (! stack.empty()){
+    act = stack.back();
+    stack.pop_back(); 
+    assert(act != NULL);
+    if (! best || act->getVisits() > best->getVisits()){
+      //"leaf" node action
+      if (! act->hasChildren() || 
+            (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
+        if (act != subTreeRoot && act->getProven() != OPP(player)){
+          best = act;
+        }
+      }
+      else {
+        Node * child = act->getFirstChild();
+        while (child != NULL){
+          stack.push_back(child);
+          child = child->getSibling();
+        }
+      }
     }
   }
-  return ss.str();
+  return best ? best : solution;
 }
 
-//---------------------------------------------------------------------
-//  section Tree
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Tree::Tree(Node* root)
+int Tree::findRivalVisits(const Node* bestMoveNode)
 {
-  assert(root->getFather() == NULL);
-  init();
-  history[0] = root; 
+  Node* subTreeRoot = root();
+  int rival = 0;
+
+  //DFS in the first layer - subtrees with less visits are skipped
+  list<Node *> stack;
+  stack.push_back(subTreeRoot);
+  while (! stack.empty()){
+    Node* act = stack.back();
+    stack.pop_back(); 
+    if (act->getVisits() <= rival){
+      continue;
+    }
+    //"leaf" node action
+    if (! act->hasChildren() || 
+          (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
+      if (act != subTreeRoot && act != bestMoveNode){
+        rival = act->getVisits();
+      }
+    }
+    else {
+      Node * child = act->getFirstChild();
+      while (child != NULL){
+        stack.push_back(child);
+        child = child->getSibling();
+      }
+    }
+  }
+  return rival;
 }
 
 //--------------------------------------------------------------------- 
 
-Tree::Tree(player_t firstPlayer)
+bool Tree::isBestMoveUnstable(const Node* bestMoveNode)
 {
-  init();
-  history[historyTop] = new Node(&(twSteps_[Step(STEP_NULL, firstPlayer)]), 0);
-  nodesNum_ = 1;
+  Node* subTreeRoot = root();
+  if (bestMoveNode->isProven()){
+    return false;
+  }
+  int minVisits = int(bestMoveNode->getVisits() * UNSTABLE_VISITS_RATIO);
+  //value from the perspective of the player to move
+  float sign = subTreeRoot->getNodeType() == NODE_MAX ? 1 : -1;
+  float bestValue = sign * bestMoveNode->getValue();
+
+  list<Node *> stack;
+  stack.push_back(subTreeRoot);
+  while (! stack.empty()){
+    Node* act = stack.back();
+    stack.pop_back(); 
+    if (act->getVisits() < minVisits){
+      continue;
+    }
+    //"leaf" node action
+    if (! act->hasChildren() || 
+          (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
+      if (act != subTreeRoot && act != bestMoveNode && sign * act->getValue() > bestValue){
+        return true;
+      }
+    }
+    else {
+      Node * child = act->getFirstChild();
+      while (child != NULL){
+        stack.push_back(child);
+        child = child->getSibling();
+      }
+    }
+  }
+  return false;
 }
 
 //--------------------------------------------------------------------- 
 
-Tree::~Tree()
+Move Tree::findBestMove(Node* bestMoveNode)
+{
+  assert(bestMoveNode != NULL && bestMoveNode != root());
+
+  Move bestMove;
+  Node* act = bestMoveNode; 
+
+  while (act!= NULL && act != root() && 
+         act->getNodeType() == bestMoveNode->getNodeType()) {
+    bestMove.prependStep(act->getStep());
+    act = act->getFather(); 
+  } 
+  
+  return bestMove;
+} 
+
+//--------------------------------------------------------------------- 
+
+bool Tree::findMostVisitedMove(const Node* father, Move& move) const
 {
-  history[0]->delChildrenRec();
-  delete history[0];
-  delete tt_;
+  if (! father->hasChildren()){
+    return false;
+  }
+  Step steps[STEPS_IN_MOVE];
+  const Node* best = NULL;
+  findMostVisitedMoveRec(father, father->getFirstChild()->getPlayer(), steps, 0, best, move);
+  return best != NULL;
 }
 
 //--------------------------------------------------------------------- 
 
-void Tree::syncMaster(){
-  root()->recSyncMaster();
+void Tree::findMostVisitedMoveRec(const Node* node, player_t player, Step* steps, int depth, 
+                                  const Node*& best, Move& move) const
+{
+  for (const Node* child = node->getFirstChild(); child != NULL; child = child->getSibling()){
+    //visits don't grow down the tree
+    if (child->getPlayer() != player || (best && child->getVisits() <= best->getVisits())){
+      continue;
+    }
+    steps[depth] = child->getStep();
+    //"leaf" node - move is finished here
+    if (! child->hasChildren() || child->getFirstChild()->getPlayer() != player || 
+        depth + 1 == STEPS_IN_MOVE){
+      if (child->getProven() != OPP(player)){
+        best = child;
+        move = Move();
+        for (int i = 0; i <= depth; i++){
+          move.appendStep(steps[i]);
+        }
+      }
+    }
+    else {
+      findMostVisitedMoveRec(child, player, steps, depth + 1, best, move);
+    }
+  }
 }
 
 //--------------------------------------------------------------------- 
 
-void Tree::expandNode(Node* node, const StepArray& steps, uint len, const HeurArray* heurs)
+void Tree::updateHistory(float sample, int count)
 {
-  Node* newChild;
-  assert(len);
-  assert(node);
-  assert(steps[0].getPlayer() == steps[len-1].getPlayer());
-  for (uint i = 0; i < len; i++){
-    newChild = new Node(&(twSteps_[steps[i]]), heurs ? (*heurs)[i] : 0);  
-    node->addChild(newChild);
-    nodesNum_++;
+  for(int i = historyTop; i > 0; i--){
+    if (shared_){
+      history[i]->removeVirtualLoss();
+    }
+    //node update
+    history[i]->update(sample, count, shared_);
+    //position value is shared with other threads
+    if (sharedTT_ && history[i]->getSharedKey()){
+      history[i]->setValue(sharedTT_->update(history[i]->getSharedKey(), sample, count));
+    }
+    //tree wide step update
+    history[i]->updateTWstep(sample, count);
   }
-  nodesExpandedNum_++;
-  
-  //expander different from representant
-  if (node->getTTitem()) {
-    NodeList * nl = node->getTTitem()->getNodes();
-    for (NodeList::iterator it = nl->begin(); it != nl->end(); it++){
-      (*it)->setFirstChild(node->getFirstChild());
+  //root update
+  history[0]->update(sample, count, shared_);
+  historyReset();
+} 
+
+//---------------------------------------------------------------------
+
+void Tree::proveHistory(player_t winner)
+{
+  actNode()->setProven(winner);
+  for (uint i = historyTop; i > 0; i--){
+    Node* node = history[i];
+    Node* father = history[i - 1];
+    //proven child is not descended anymore
+    father->cCacheInvalidate();
+
+    player_t player = node->getPlayer();
+    if (node->getProven() != player){
+      //loss for the player - proven only if all his steps lose
+      if (father->getPendingSteps() && father->getPendingSteps()->hasNext()){
+        break;
+      }
+      Node* child = father->getFirstChild();
+      while (child != NULL && child->getProven() == OPP(player)){
+        child = child->getSibling();
+      }
+      if (child != NULL){
+        break;
+      }
     }
+    father->setProven(node->getProven());
   }
+}
 
-  //ccache init
-  if (cfg.childrenCache()){
-    node->cCacheInit();
+//---------------------------------------------------------------------
+
+void Tree::collectFirstMoveStats(NodeStats& stats, int minVisits)
+{
+  NodeStat stat;
+  stat.stepsNum = 0;
+  stat.visits = root()->getVisits();
+  stat.value = root()->getValue();
+  stats.push_back(stat);
+
+  //dfs (fathers first) through the nodes of the first move
+  list<pair<Node*, int> > stack;
+  stack.push_back(make_pair(root(), 0));
+  while (! stack.empty()){
+    Node* node = stack.back().first;
+    int index = stack.back().second;
+    stack.pop_back();
+
+    Node* child = node->getFirstChild();
+    while (child != NULL){
+      if (child->getNodeType() == root()->getNodeType() && 
+          child->getVisits() >= minVisits && stats[index].stepsNum < STEPS_IN_MOVE){
+        stat = stats[index];
+        stat.steps[stat.stepsNum++] = child->getStep();
+        stat.visits = child->getVisits();
+        stat.value = child->getValue();
+        stats.push_back(stat);
+        stack.push_back(make_pair(child, int(stats.size() - 1)));
+      }
+      child = child->getSibling();
+    }
   }
+}
+
+//---------------------------------------------------------------------
 
-  node->connectChildrenToMaster();
+void Tree::mergeFirstMoveStats(const NodeStats& stats, const Board* board)
+{
+  for (NodeStats::const_iterator it = stats.begin(); it != stats.end(); it++){
+    if (board && ! isPathAllowed(board, it->steps, it->stepsNum)){
+      continue;
+    }
+    Node* node = root();
+    for (int i = 0; i < it->stepsNum && node; i++){
+      Node* father = node;
+      node = father->getFirstChild();
+      while (node != NULL && ! (node->getStep() == it->steps[i])){
+        node = node->getSibling();
+      }
+      //only the last step might be missing (fathers come first)
+      if (node == NULL && i == it->stepsNum - 1){
+        node = new Node(it->steps[i], &((*twSteps_)[it->steps[i]]), 0);
+        node->setVisits(0);
+        father->addChild(node);
+        nodesNum_++;
+      }
+    }
+    int visits = node ? node->getVisits() + it->visits : 0;
+    if (visits <= 0){
+      continue;
+    }
+    node->setValue((node->getValue() * node->getVisits() + it->value * it->visits) / visits);
+    node->setVisits(visits);
+  }
 }
 
-//--------------------------------------------------------------------- 
+//---------------------------------------------------------------------
 
-void Tree::expandNodeLimited(Node* node, const Move& move)
+bool Tree::isPathAllowed(const Board* board, const Step* steps, int stepsNum) const
 {
-  Node* newChild;
-  StepList stepList = move.getStepList();
-  assert(! stepList.empty());
-  assert(node);
-  for (StepListIter it = stepList.begin(); it != stepList.end(); it++){
-    newChild = new Node(&twSteps_[*it]);
-    node->addChild(newChild);
-    //for parallel mode(otherwise the nodes would not be in the master tree)
-    newChild->connectToMaster();
-    node = newChild;
-    nodesNum_++;
-    nodesExpandedNum_++;
+  Board* playBoard = new Board(*board);
+  bool allowed = true;
+  for (int i = 0; i < stepsNum && allowed; i++){
+    StepArray step;
+    step[0] = steps[i];
+    allowed = playBoard->filterRepetitions(step, 1) == 1;
+    if (allowed){
+      playBoard->makeStepTryCommit(steps[i]);
+    }
+  }
+  delete playBoard;
+  return allowed;
+}
+
+//---------------------------------------------------------------------
+
+void Tree::historyPush(Node* node)
+{
+  assert(node != NULL);
+  assert(historyTop + 1 < 2 * UCT_MAX_DEPTH);
+  if (shared_){
+    node->addVirtualLoss();
   }
+  history[++historyTop] = node;
+}
+
+//---------------------------------------------------------------------
+
+void Tree::historyReset()
+{
+  historyTop = 0;
+}
+
+//---------------------------------------------------------------------
+
+Node* Tree::root() 
+{
+  return history[0];
+}
+
+//---------------------------------------------------------------------
+
+Node* Tree::actNode() 
+{
+  return history[historyTop];
+}
+
+//--------------------------------------------------------------------- 
+
+int Tree::getNodesNum() 
+{
+  return nodesNum_;
+}
+
+//--------------------------------------------------------------------- 
+
+int Tree::getNodesPrunedNum() 
+{
+  return nodesPrunedNum_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Tree::uctDescend()
+int Tree::getNodesExpandedNum() 
 {
-  assert(actNode()->hasChildren());
-  history[historyTop + 1]= actNode()->findUctChild(history[historyTop]);
-  historyTop++;
-  assert(actNode() != NULL);
+  return nodesExpandedNum_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Tree::randomDescend()
+int Tree::getNodesReleasedNum() 
 {
-  assert(actNode()->hasChildren());
-  history[historyTop + 1]= actNode()->findRandomChild();
-  historyTop++;
-  assert(actNode() != NULL);
+  return nodesReleasedNum_;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Tree::firstChildDescend()
+static bool lessVisited(const Node* a, const Node* b)
 {
-  assert(actNode()->hasChildren());
-  history[historyTop + 1]= actNode()->getFirstChild();
-  historyTop++;
-  assert(actNode() != NULL);
+  return a->getVisits() < b->getVisits();
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Tree::findBestMoveNode(Node* subTreeRoot)
+void Tree::pruneLeastVisited(int targetNodesNum, set<const Node*>* released)
 {
-  Node* act = subTreeRoot; 
+  assert(historyTop == 0);
+  vector<Node*> frontier;
 
-  while (true){
-    if (! act->hasChildren() || 
-          (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
-      break;
-    }
-    act = act->findMostExploredChild();
+  //snapshots might belong to released nodes 
+  if (snapshots_){
+    snapshots_->clear();
   }
 
-  //Now we have some good solution - DFS in the 
-  //first layer of the tree follows
-  Node * best = act;
-  list<Node *> stack;
-  stack.clear();
-  stack.push_back(subTreeRoot);
-  while (! stack.empty()){
-    act = stack.back();
-    stack.pop_back(); 
-    assert(act != NULL);
-    if (act->getVisits() > best->getVisits()){
-      //"leaf" node action
-      if (! act->hasChildren() || 
-            (act->getFirstChild()->getNodeType() != subTreeRoot->getNodeType())){
-        best = act;
-      }
-      else {
-        Node * child = act->getFirstChild();
-        while (child != NULL){
-          stack.push_back(child);
-          child = child->getSibling();
-        }
-      }
+  while (nodesNum_ > targetNodesNum){
+    frontier.clear();
+    set<const TTitem*> positions;
+    collectFrontier(root(), frontier, positions);
+    if (frontier.empty()){
+      break;
+    }
+    sort(frontier.begin(), frontier.end(), lessVisited);
+    for (vector<Node*>::iterator it = frontier.begin(); 
+         it != frontier.end() && nodesNum_ > targetNodesNum; it++){
+      releaseChildren(*it, released);
     }
   }
-  return best;
 }
 
 //--------------------------------------------------------------------- 
 
-Move Tree::findBestMove(Node* bestMoveNode)
+void Tree::detachMaster(const set<const Node*>& released)
 {
-  assert(bestMoveNode != NULL && bestMoveNode != root());
-
-  Move bestMove;
-  Node* act = bestMoveNode; 
-
-  while (act!= NULL && act != root() && 
-         act->getNodeType() == bestMoveNode->getNodeType()) {
-    bestMove.prependStep(act->getStep());
-    act = act->getFather(); 
-  } 
-  
-  return bestMove;
-} 
+  //nodes of the shared tree might be released - their snapshots go
+  if (shared_){
+    if (snapshots_){
+      snapshots_->clear();
+    }
+    return;
+  }
+  set<const Node*> visited;
+  detachMasterRec(root(), released, visited);
+}
 
 //--------------------------------------------------------------------- 
 
-void Tree::updateHistory(float sample)
+void Tree::detachMasterRec(Node* node, const set<const Node*>& released, set<const Node*>& visited)
 {
-  for(int i = historyTop; i > 0; i--){
-    //node update
-    history[i]->update(sample);
-    //tree wide step update
-    history[i]->updateTWstep(sample);
+  for (Node* child = node->getFirstChild(); child != NULL; child = child->getSibling()){
+    if (! child->getMaster() || ! visited.insert(child).second){
+      continue;
+    }
+    if (released.count(child->getMaster())){
+      child->setMaster(NULL);
+      continue;
+    }
+    detachMasterRec(child, released, visited);
   }
-  //root update
-  history[0]->update(sample);
-  historyReset();
-} 
+}
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-void Tree::historyReset()
+Board* Tree::restoreBoard(const Board* rootBoard)
 {
-  historyTop = 0;
+  const Board* source = rootBoard;
+  uint start = 0;
+
+  if (snapshots_){
+    for (uint i = historyTop; i > 0; i--){
+      const Board* snapshot = snapshots_->load(history[i]);
+      if (snapshot){
+        source = snapshot;
+        start = i;
+        break;
+      }
+    }
+  }
+
+  Board* board = new Board(*source);
+  for (uint i = start + 1; i <= historyTop; i++){
+    if (board->makeStepTryCommit(history[i]->getStep())){
+      if (board->getWinner() != NO_PLAYER){
+        //release the rest of the history 
+        for (uint j = i + 1; shared_ && j <= historyTop; j++){
+          history[j]->removeVirtualLoss();
+        }
+        historyTop = i;
+        break;
+      }
+      if (snapshots_ && history[i]->getVisits() >= SNAPSHOT_MIN_VISITS){
+        snapshots_->store(history[i], history[i]->getVisits(), board);
+      }
+    }
+  }
+  return board;
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Tree::root() 
+void Tree::collectFrontier(Node* node, vector<Node*>& frontier, set<const TTitem*>& positions)
 {
-  return history[0];
+  //children of the position are handled once
+  if (node->getTTitem() && ! positions.insert(node->getTTitem()).second){
+    return;
+  }
+
+  bool leafChildren = true;
+  Node* child = node->getFirstChild();
+  while (child != NULL){
+    if (child->hasChildren()){
+      leafChildren = false;
+      collectFrontier(child, frontier, positions);
+    }
+    child = child->getSibling();
+  }
+
+  if (leafChildren && node->hasChildren() && node != root()){
+    frontier.push_back(node);
+  }
 }
 
-//---------------------------------------------------------------------
+//--------------------------------------------------------------------- 
 
-Node* Tree::actNode() 
+void Tree::releaseChildren(Node* node, set<const Node*>* released)
 {
-  return history[historyTop];
+  Node* child = node->getFirstChild();
+  Node* sibling;
+  while (child != NULL){
+    assert(! child->hasChildren());
+    sibling = child->getSibling();
+    //don't lose statistics gathered since last sync
+    if (child->getMaster()){
+      child->syncMaster();
+    }
+    releaseNode(child, released);
+    child = sibling;
+  }
+
+  delete node->getPendingSteps();
+  //children of the position are cleared for all nodes leading to it
+  node->clearChildren();
 }
 
 //--------------------------------------------------------------------- 
 
-int Tree::getNodesNum() 
-{
-  return nodesNum_;
+void Tree::releaseNode(Node* node, set<const Node*>* released)
+{
+  TTitem* item = node->getTTitem();
+  TTitem* stored = NULL;
+  //last node leading to the position - remove the position from tt 
+  //(unless the entry has been replaced meanwhile)
+  if (item && item->getRefs() == 1 && 
+      tt_->loadItem(item->getSignature(), item->getPlayerIndex(), 
+                    stored, item->getDepthIdentifier()) &&
+      stored == item){
+    tt_->removeItem(item->getSignature(), item->getPlayerIndex(), 
+                    item->getDepthIdentifier());
+  }
+  if (released){
+    released->insert(node);
+  }
+  delete node;
+  nodesNum_--;
+  nodesReleasedNum_++;
 }
 
 //--------------------------------------------------------------------- 
 
-int Tree::getNodesPrunedNum() 
+void Tree::addNodes(int num)
 {
-  return nodesPrunedNum_;
+  nodesNum_ += num;
+  if (shared_){
+    __sync_add_and_fetch(&masterTree_->nodesNum_, num);
+  }
 }
 
 //--------------------------------------------------------------------- 
 
-int Tree::getNodesExpandedNum() 
+void Tree::addMasterNodes(int num)
 {
-  return nodesExpandedNum_;
+  if (masterTree_ && num){
+    __sync_add_and_fetch(&masterTree_->nodesNum_, num);
+  }
 }
 
 //--------------------------------------------------------------------- 
@@ -1123,44 +2867,74 @@ void Tree::updateTT(Node* father, const Board* board)
 {
   assert(father != NULL); 
   Node* node = father->getFirstChild(); 
-  NodeList* rep = NULL; 
-  Node* repNode = NULL; 
+  while (node != NULL){
+    updateTTnode(node, board);
+    node = node->getSibling();
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::updateTTnode(Node* node, const Board* board)
+{
+  TTitem* item = NULL; 
   u64 afterStepSignature;
+
+  //pass is not handled in the TT
+  if (node->getStep().isPass() || node->getStep().isNull()){
+    return;
+  }
+  //node is linked while it's a leaf
+  assert(! node->hasChildren());
+  afterStepSignature = board->calcAfterStepSignature(node->getStep());
+  //inside the move legal steps depend on the position the move started from 
+  //(virtual passes) - positions are merged only within the same move then
+  if (board->getStepCount() + node->getStep().count() < STEPS_IN_MOVE){
+    u64 moveStart = board->getPreMoveSignature();
+    afterStepSignature ^= (moveStart << 1) | (moveStart >> 63);
+  }
+  //check whether position was encountered already
+  if (tt_->loadItem(afterStepSignature, 
+                   board->getPlayerToMove(), 
+                   item,
+                   node->getDepthIdentifier())){
+    assert(item != NULL);
+    nodesPrunedNum_++;
+    //statistics and children of the position are shared
+    node->setTTitem(item);
+
+  }else{
+    //position is not in tt yet -> store it 
+    item = new TTitem(afterStepSignature, board->getPlayerToMove(), 
+                      node->getDepthIdentifier());
+    node->setTTitem(item);
+    tt_->insertItem(afterStepSignature,
+                  board->getPlayerToMove(), 
+                  item, 
+                  node->getDepthIdentifier());
+    //initial update
+    node->updateTTitem(node->getValue() * node->getVisits(), node->getVisits());
+  }
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::updateSharedTT(Node* father, const Board* board)
+{
+  assert(father != NULL); 
+  Node* node = father->getFirstChild(); 
   while (node != NULL){
     //pass is not handled in the TT
-    if (node->getStep().isPass() || node->getStep().isNull()){
-      node = node->getSibling();
-      continue;
-    }
-    afterStepSignature = board->calcAfterStepSignature(node->getStep());
-    //check whether position was encountered already
-    if (tt_->loadItem(afterStepSignature, 
-                     board->getPlayerToMove(), 
-                     rep,
-                     node->getDepthIdentifier())){
-      assert(rep != NULL);
-      repNode = rep->front(); 
-      nodesPrunedNum_++;
-
-      //TODO there are issues in children sharing in connection with virtual passes 
-      //what is a virtual pass in one node doesn't have to be a virtual pass in another
-      node->setFirstChild(repNode->getFirstChild());
-      node->setTTitem(repNode->getTTitem());
-      node->setValue(repNode->getValue());
-      rep->push_back(node);
-      //node->setVisits(repNode->getVisits());
-
-    }else{
-      //position is not in tt yet -> store it 
-      rep = new NodeList();
-      rep->push_back(node);
-      node->setTTitem(new TTitem(rep));
-      tt_->insertItem(afterStepSignature,
-                    board->getPlayerToMove(), 
-                    rep, 
-                    node->getDepthIdentifier());
-      //initial update
-      node->updateTTbrothers(node->getValue() * node->getVisits(), node->getVisits());
+    if (! node->getStep().isPass() && ! node->getStep().isNull()){
+      u64 key = sharedTT_->getKey(board->calcAfterStepSignature(node->getStep()), 
+                                  board->getPlayerToMove(), 
+                                  node->getDepthIdentifier());
+      node->setSharedKey(key);
+      float value;
+      int visits;
+      if (sharedTT_->load(key, value, visits)){
+        node->setValue(value);
+      }
     }
     node = node->getSibling();
   }
@@ -1175,17 +2949,65 @@ Tree::Tree()
 
 //--------------------------------------------------------------------- 
 
-void Tree::init()
+TT* Tree::ttPool_[TT_POOL_SIZE];
+int Tree::ttPoolNum_ = 0;
+pthread_mutex_t Tree::ttPoolLock_ = PTHREAD_MUTEX_INITIALIZER;
+
+TT* Tree::acquireTT()
+{
+  TT* tt = NULL;
+  pthread_mutex_lock(&ttPoolLock_);
+  if (ttPoolNum_ > 0){
+    tt = ttPool_[--ttPoolNum_];
+  }
+  pthread_mutex_unlock(&ttPoolLock_);
+  return tt ? tt : new TT(TT_INIT_SIZE, TT_SIZE);
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::releaseTT(TT* tt)
+{
+  tt->clear();
+  pthread_mutex_lock(&ttPoolLock_);
+  if (ttPoolNum_ < TT_POOL_SIZE){
+    ttPool_[ttPoolNum_++] = tt;
+    tt = NULL;
+  }
+  pthread_mutex_unlock(&ttPoolLock_);
+  delete tt;
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::freeTTpool()
+{
+  pthread_mutex_lock(&ttPoolLock_);
+  while (ttPoolNum_ > 0){
+    delete ttPool_[--ttPoolNum_];
+  }
+  pthread_mutex_unlock(&ttPoolLock_);
+}
+
+//--------------------------------------------------------------------- 
+
+void Tree::init(TWsteps* twSteps, bool shared, SharedTT* sharedTT)
 {
-  tt_ = new TT();
+  shared_ = shared;
+  masterTree_ = NULL;
+  sharedTT_ = shared_ ? NULL : sharedTT;
   //root is NOT saved in tt
+  tt_ = shared_ ? NULL : acquireTT();
 
   history[0] = NULL; 
-  twSteps_.clear();
+  ownTWsteps_ = twSteps == NULL;
+  twSteps_ = ownTWsteps_ ? new TWsteps() : twSteps;
   historyTop = 0;
   nodesExpandedNum_ = 0;
   nodesNum_ = 0;
   nodesPrunedNum_ = 0;
+  nodesReleasedNum_ = 0;
+  snapshots_ = cfg.boardSnapshots() > 0 ? new SnapshotCache(cfg.boardSnapshots()) : NULL;
 }
 
 //--------------------------------------------------------------------- 
@@ -1208,37 +3030,82 @@ Uct::Uct()
 
 Uct::Uct(const Board* board)
 {
-  init(board);
+  init(board, new Tree(board->getPlayerToMove()));
 }
 
 //--------------------------------------------------------------------- 
 
-Uct::Uct(const Board* board, const Uct* masterUct)
+Uct::Uct(const Board* board, Uct* masterUct, SharedTT* sharedTT)
 {
-  init(board);
+  //advisor might be shared through the master's one
+  ContextMoves* contextMoves = masterUct && cfg.sharedAdvisor() ? 
+                               masterUct->advisor_->getContextMoves() : NULL;
+  if (masterUct && cfg.sharedTree()){
+    //all threads descend the master's tree
+    init(board, new Tree(masterUct->tree_), contextMoves);
+  }
+  else {
+    //history heuristic might be shared through the master tree
+    TWsteps* twSteps = masterUct && cfg.sharedHistory() ? masterUct->tree_->twSteps_ : NULL;
+    init(board, new Tree(board->getPlayerToMove(), twSteps, sharedTT), contextMoves);
+    if (masterUct){
+      tree_->root()->setMaster(masterUct->tree_->root());
+      tree_->masterTree_ = masterUct->tree_;
+    }
+  }
+  //master prunes its tree only with all its workers paused
   if (masterUct){
-    tree_->root()->setMaster(masterUct->tree_->root());
+    masterUct_ = masterUct;
+    pthread_rwlock_wrlock(&masterUct_->pruneLock_);
+    masterUct_->workers_.push_back(this);
+    pthread_rwlock_unlock(&masterUct_->pruneLock_);
   }
 }
 
 //--------------------------------------------------------------------- 
 
-void Uct::init(const Board* board)
+Uct::Uct(const Board* board, const Uct* uct, const Node* node)
+{
+  init(board, new Tree(uct->tree_, node, board));
+}
+
+//--------------------------------------------------------------------- 
+
+void Uct::init(const Board* board, Tree* tree, ContextMoves* contextMoves)
 {
   eval_  = new Eval(board);
-  tree_  = new Tree(board->getPlayerToMove());
-  advisor_ = new MoveAdvisor();
+  tree_  = tree;
+  advisor_ = new MoveAdvisor(contextMoves);
+  playoutPool_ = NULL;
+  tacticsPool_ = NULL;
 
   bestMoveNode_ = NULL;
   bestMoveRepr_ = "";
   playouts_ = 0;
+  playoutsLimit_ = -1;
+  nodesLimit_ = -1;
   uctDescends_ = 0; 
+
+  masterUct_ = NULL;
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  //pruning must not starve behind the stream of playouts
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&pruneLock_, &attr);
+  pthread_rwlockattr_destroy(&attr);
 }
 
 //---------------------------------------------------------------------
 
 Uct::~Uct()
 {
+  if (masterUct_){
+    pthread_rwlock_wrlock(&masterUct_->pruneLock_);
+    masterUct_->workers_.erase(
+      find(masterUct_->workers_.begin(), masterUct_->workers_.end(), this));
+    pthread_rwlock_unlock(&masterUct_->pruneLock_);
+  }
+  pthread_rwlock_destroy(&pruneLock_);
   delete eval_;
   delete tree_;
   delete advisor_;
@@ -1246,12 +3113,30 @@ Uct::~Uct()
 
 //--------------------------------------------------------------------- 
 
+void Uct::mergeRemoteStatistics(const NodeStats& stats, int playouts, const Board* board)
+{
+  //remote search doesn't know the game history
+  tree_->mergeFirstMoveStats(stats, board);
+  playouts_ += playouts;
+}
+
+//--------------------------------------------------------------------- 
+
+void Uct::setSearchLimits(int playouts, int nodes)
+{
+  playoutsLimit_ = playouts;
+  nodesLimit_ = nodes;
+}
+
+//--------------------------------------------------------------------- 
+
 void Uct::updateStatistics(Uct* ucts[], int uctsNum)
 {
   int pl = 0;
   int ud = 0;
   int nodesExpanded = 0;
   int nodesPruned = 0;
+  int nodesReleased = 0;
   int nodes = 0;
   for (int i = 0; i < uctsNum; i++){
     pl += ucts[i]->getPlayoutsNum();
@@ -1259,23 +3144,72 @@ void Uct::updateStatistics(Uct* ucts[], int uctsNum)
     nodes += ucts[i]->getTree()->getNodesNum();
     nodesExpanded += ucts[i]->getTree()->getNodesExpandedNum();
     nodesPruned += ucts[i]->getTree()->getNodesPrunedNum();
+    nodesReleased += ucts[i]->getTree()->getNodesReleasedNum();
   }
   playouts_ = pl;
   uctDescends_ = ud;
+  if (uctsNum && ucts[0]->tree_->isShared()){
+    //nodes of the views are counted in the shared tree already
+    tree_->nodesExpandedNum_ = nodesExpanded;
+    return;
+  }
   tree_->nodesNum_ = nodes/float(uctsNum);
   tree_->nodesExpandedNum_ = nodesExpanded/float(uctsNum);
   tree_->nodesPrunedNum_ = nodesPruned/float(uctsNum);
+  tree_->nodesReleasedNum_ = nodesReleased/float(uctsNum);
 }
 
 //---------------------------------------------------------------------
 
-void Uct::searchTree(const Board* refBoard, const Engine* engine)
+void Uct::searchTree(const Board* refBoard, const Engine* engine, PlayoutPool* playoutPool, 
+                     TaskPool* tacticsPool)
 {
   Board* board = new Board(*refBoard);
-  while (! engine->checkSearchStop()){
-    doPlayout(board);
+  playoutPool_ = playoutPool;
+  tacticsPool_ = tacticsPool;
+  //tactics tasks fill the context moves concurrently
+  bool asyncTactics = useAsyncTactics();
+  if (asyncTactics){
+    advisor_->getContextMoves()->addUser();
+  }
+  //search is over when the root is proven or the budget is spent (reused nodes don't count)
+  int playouts = 0;
+  int nodesStart = tree_->getNodesNum();
+  //playouts hold the master's lock - the master/shared tree is pruned between them
+  pthread_rwlock_t* pruneLock = masterUct_ && cfg.maxNodes() ? &masterUct_->pruneLock_ : NULL;
+  while (true){
+    if (pruneLock){
+      pthread_rwlock_rdlock(pruneLock);
+    }
+    bool stop = engine->checkSearchStop(this, ++playouts % BEST_MOVE_CHECK_INTERVAL == 0) || 
+                tree_->root()->isProven() || 
+                (playoutsLimit_ >= 0 && playouts_ >= playoutsLimit_) || 
+                (nodesLimit_ >= 0 && tree_->getNodesNum() - nodesStart >= nodesLimit_);
+    if (! stop){
+      doPlayout(board);
+      if (cfg.maxNodes() && ! tree_->isShared() && tree_->getNodesNum() > cfg.maxNodes()){
+        tree_->historyReset();
+        tree_->pruneLeastVisited(int(cfg.maxNodes() * PRUNE_TARGET_RATIO));
+      }
+    }
+    if (pruneLock){
+      pthread_rwlock_unlock(pruneLock);
+    }
+    if (stop){
+      break;
+    }
+    if (pruneLock && masterUct_->tree_->getNodesNum() > cfg.maxNodes()){
+      masterUct_->pruneMaster(int(cfg.maxNodes() * PRUNE_TARGET_RATIO));
+    }
+  }
+  //tasks refer to the uct
+  attachTactics(true);
+  if (asyncTactics){
+    advisor_->getContextMoves()->releaseUser();
   }
   delete board;
+  playoutPool_ = NULL;
+  tacticsPool_ = NULL;
 
   //this slows down a lot (final tree might be big) 
   //and is virtually useless since syncing is continuous
@@ -1284,6 +3218,24 @@ void Uct::searchTree(const Board* refBoard, const Engine* engine)
 
 //--------------------------------------------------------------------- 
 
+void Uct::pruneMaster(int targetNodesNum)
+{
+  pthread_rwlock_wrlock(&pruneLock_);
+  //some other worker might have pruned meanwhile
+  if (tree_->getNodesNum() > cfg.maxNodes()){
+    tree_->historyReset();
+    set<const Node*> released;
+    tree_->pruneLeastVisited(targetNodesNum, &released);
+    //workers' nodes above the cut stay linked and keep syncing their subtrees
+    for (vector<Uct*>::iterator it = workers_.begin(); it != workers_.end(); it++){
+      (*it)->tree_->detachMaster(released);
+    }
+  }
+  pthread_rwlock_unlock(&pruneLock_);
+}
+
+//--------------------------------------------------------------------- 
+
 void Uct::refineResults(const Board* board) 
 {
   bestMoveNode_ = tree_->findBestMoveNode(tree_->root());
@@ -1297,9 +3249,14 @@ void Uct::refineResults(const Board* board)
 
 void Uct::doPlayout(const Board* board)
 {
-  Board *playBoard = new Board(*board);
+  //board is restored lazily - only when it is needed 
+  Board *playBoard = NULL;
   playoutStatus_e playoutStatus;
 
+  if (! tacticsTasks_.empty()){
+    attachTactics();
+  }
+
   //point tree's actNode to the root 
   tree_->historyReset();    
 
@@ -1309,6 +3266,9 @@ void Uct::doPlayout(const Board* board)
    logDDebug(tree_->actNode()->toString().c_str());
   
     if (! tree_->actNode()->hasChildren()) { 
+      if (! restorePlayBoard(board, playBoard)){
+        break;
+      }
       if (tree_->actNode()->getDepth() < UCT_MAX_DEPTH - 1) {
         if (tree_->actNode()->isMature()) {
           Move move;
@@ -1317,18 +3277,20 @@ void Uct::doPlayout(const Board* board)
           //
           if (playBoard->getStepCount() == 0 && playBoard->goalCheck(&move)){
             assert(playBoard->getWinner() == NO_PLAYER );
-            float value = WINNER_TO_VALUE(playBoard->getPlayerToMove());
+            player_t winner = playBoard->getPlayerToMove();
             tree_->expandNodeLimited(tree_->actNode(), move);
             //descend to the expanded area
             while (tree_->actNode() && tree_->actNode()->hasChildren()){
               tree_->firstChildDescend();
             }
-            tree_->updateHistory(value);
+            tree_->proveHistory(winner);
+            tree_->updateHistory(WINNER_TO_VALUE(winner));
             break;
           }
           
+          bool asyncTactics = useAsyncTactics();
           //tactics in playouts extension
-          if (cfg.moveAdvisor()){
+          if (cfg.moveAdvisor() && ! asyncTactics){
             fill_advisor(playBoard); 
           } 
 
@@ -1337,14 +3299,29 @@ void Uct::doPlayout(const Board* board)
 
           stepsNum = playBoard->genStepsNoPass(playBoard->getPlayerToMove(), steps);
           stepsNum = playBoard->filterRepetitions(steps, stepsNum);
+          //other orders of independent steps reach the same positions
+          if (cfg.canonicalSteps()){
+            stepsNum = playBoard->filterCommuting(steps, stepsNum);
+          }
 
           //add pass if possible
           if (playBoard->canPass()) { 
             steps[stepsNum++] = Step(STEP_PASS, playBoard->getPlayerToMove());
           }
 
+          //progressive widening needs the heuristics to order the steps
+          bool heuristics = (cfg.knowledgeInTree() || cfg.progressiveWidening()) && stepsNum > 0;
+          if (asyncTactics && (cfg.moveAdvisor() || heuristics)){
+            //descend continues, heuristics are attached when ready 
+            TacticsTask* task = new TacticsTask(this, tree_->actNode(), playBoard, 
+                                                steps, stepsNum, heuristics);
+            tacticsTasks_.push_back(task);
+            tacticsPool_->submit(task);
+            heuristics = false;
+          }
+
           if (stepsNum > 0) {
-            if (cfg.knowledgeInTree()){
+            if (heuristics){
               HeurArray heurs;
               playBoard->getHeuristics(steps, stepsNum, heurs);
               tree_->expandNode(tree_->actNode(), steps, stepsNum, &heurs);
@@ -1352,9 +3329,12 @@ void Uct::doPlayout(const Board* board)
             else{
               tree_->expandNode(tree_->actNode(), steps, stepsNum);
             }
-            if (cfg.uct_tt()){
+            if (tree_->useTT()){
               tree_->updateTT(tree_->actNode(), playBoard); 
             }
+            if (tree_->useSharedTT()){
+              tree_->updateSharedTT(tree_->actNode(), playBoard); 
+            }
           }
           //imobilization, expand with null step
           else{
@@ -1371,20 +3351,48 @@ void Uct::doPlayout(const Board* board)
       int base = 1 + (glob.grand()->getOne() % cfg.playoutLen());
       int playoutLen = base + (tree_->actNode()->getNodeType() == tree_->root()->getNodeType() ? 1 : 0);
            
+      //workers play from the leaf meanwhile
+      if (playoutPool_){
+        playoutPool_->startPlayouts(this, playBoard, playoutLen);
+      }
+
       AdvisorPlayout playoutManager(playBoard, MAX_PLAYOUT_LENGTH, playoutLen, advisor_);
 
       playoutStatus = playoutManager.doPlayout();
       float sample = decidePlayoutWinner(playBoard);
-      tree_->updateHistory(sample);
       if (cfg.moveAdvisor()){
         advisor_->update(sample);
       }
+      if (playoutPool_){
+        //all samples are backed up at once
+        int count = 1 + playoutPool_->getWorkersNum();
+        sample = (sample + playoutPool_->waitPlayouts()) / count;
+        playouts_ += count - 1;
+        tree_->updateHistory(sample, count);
+      }
+      else{
+        tree_->updateHistory(sample);
+      }
       break;
     } //no children
 
+    //materialize next child if node was visited enough
+    if (tree_->actNode()->canWiden()){
+      //tt update needs the board
+      if (tree_->useTT() && ! restorePlayBoard(board, playBoard)){
+        break;
+      }
+      tree_->widenNode(tree_->actNode(), playBoard);
+    }
+
     tree_->uctDescend(); 
     uctDescends_++;
 
+    //steps are replayed later (from snapshot) when the board is needed
+    if (! playBoard){
+      continue;
+    }
+
     Step step = tree_->actNode()->getStep();
 
 
@@ -1392,6 +3400,7 @@ void Uct::doPlayout(const Board* board)
     if (playBoard->makeStepTryCommit(step) )   {
       //commit was successful - check whether winning criteria are reached already
       if (playBoard->getWinner() != NO_PLAYER ) {
+        tree_->proveHistory(playBoard->getWinner());
         tree_->updateHistory(WINNER_TO_VALUE(playBoard->getWinner()));
         break;  //winner is known already in the uct tree -> no need to go deeper
       }
@@ -1417,11 +3426,21 @@ string Uct::getStats(float seconds) const
         << "  " << tree_->getNodesNum() << " nodes in the tree" << endl 
         << "  " << tree_->getNodesExpandedNum() << " nodes expanded" << endl 
         << "  " << tree_->getNodesPrunedNum() << " nodes pruned" << endl 
+        << "  " << tree_->getNodesReleasedNum() << " nodes released" << endl 
         << "  " << uctDescends_/float(playouts_) << " average descends in playout" << endl 
         << "  " << "best move: " << getBestMoveRepr() << endl 
         << "  " << "best move visits: " << getBestMoveVisits() << endl 
         << "  " << "win condidence: " << getWinRatio() << endl 
       ;
+  if (tree_->root()->isProven()){
+    ss << "  " << "proven win for " << (tree_->root()->getProven() == GOLD ? "gold" : "silver") << endl;
+  }
+  if (cfg.moveAdvisor()){
+    ContextMoves* contextMoves = advisor_->getContextMoves();
+    ss << "  " << contextMoves->size(GOLD) + contextMoves->size(SILVER) << " context moves (" 
+       << contextMoves->getReplaced() << " replaced, " 
+       << contextMoves->getDropped() << " dropped when full)" << endl;
+  }
 
   return ss.str();
 }
@@ -1460,6 +3479,10 @@ float Uct::getBestMoveValue() const
 float Uct::getWinRatio() const
 {
   float ratio = (bestMoveNode_) ? (bestMoveNode_->getValue() + 1 )/2 : 0.5;
+  //proven result is sure
+  if (bestMoveNode_ && bestMoveNode_->isProven()){
+    ratio = bestMoveNode_->getProven() == GOLD ? 1 : 0;
+  }
   assert(tree_->root());
   return (tree_->root()->getNodeType() == NODE_MAX) ? ratio : 1 - ratio;
 }
@@ -1480,6 +3503,24 @@ int Uct::getPlayoutsNum() const
 
 //--------------------------------------------------------------------- 
 
+bool Uct::restorePlayBoard(const Board* board, Board* & playBoard)
+{
+  if (playBoard){
+    return true;
+  }
+
+  playBoard = tree_->restoreBoard(board);
+  //game ended in the descend
+  if (playBoard->getWinner() != NO_PLAYER){
+    tree_->proveHistory(playBoard->getWinner());
+    tree_->updateHistory(WINNER_TO_VALUE(playBoard->getWinner()));
+    return false;
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------- 
+
 double Uct::decidePlayoutWinner(const Board* playBoard) const
 {
   if IS_PLAYER(playBoard->getWinner()){
@@ -1532,6 +3573,37 @@ void Uct::fill_advisor(const Board * playBoard) {
   
 }
 
+//--------------------------------------------------------------------- 
+
+bool Uct::useAsyncTactics() const
+{
+  return tacticsPool_ && ! cfg.progressiveWidening() && ! cfg.maxNodes();
+}
+
+//--------------------------------------------------------------------- 
+
+void Uct::attachTactics(bool all)
+{
+  list<TacticsTask*>::iterator it = tacticsTasks_.begin();
+  while (it != tacticsTasks_.end()){
+    TacticsTask* task = *it;
+    if (all){
+      //search is over - results are not needed
+      task->cancel();
+      tacticsPool_->wait(task);
+    }
+    else if (task->isDone()){
+      task->attach();
+    }
+    else{
+      it++;
+      continue;
+    }
+    delete task;
+    it = tacticsTasks_.erase(it);
+  }
+}
+
 //--------------------------------------------------------------------- 
 //--------------------------------------------------------------------- 
 
@@ -7,16 +7,22 @@
 
 #pragma once 
 
+#include <algorithm>
 #include <cmath>
+#include <deque>
 #include <queue>
 #include <set>
+#include <vector>
 
 #include "hash.h"
 
 using std::map;
+using std::deque;
 using std::queue;
 using std::sqrt;
 using std::set;
+using std::vector;
+using std::sort;
 using std::make_pair;
 
 #define MAX_PLAYOUT_LENGTH 100  //these are 2 "moves" ( i.e. maximally 2 times 4 steps ) 
@@ -25,8 +31,15 @@ using std::make_pair;
 #define CCACHE_START_THRESHOLD 50 
 #define EVAL_AFTER_LENGTH (cfg.playoutLen())
 #define FPU 0.9
+//after exceeding the nodes limit, tree is pruned to this ratio of the limit
+#define PRUNE_TARGET_RATIO 0.9
+//number of visits needed for storing board snapshot of the node
+#define SNAPSHOT_MIN_VISITS 20
+//how often (playouts) search thread lets engine check the best move (time management)
+#define BEST_MOVE_CHECK_INTERVAL 1024
+//rivals with this ratio of the best move's visits are considered in the stability check
+#define UNSTABLE_VISITS_RATIO 0.5
 
-#define NODE_VICTORY(node_type) (node_type == NODE_MAX ? 2 : -1 )
 #define WINNER_TO_VALUE(winner) (winner == GOLD ? 1 : -1 )
 
 enum playoutStatus_e {PLAYOUT_OK, PLAYOUT_TOO_LONG, PLAYOUT_EVAL}; 
@@ -126,65 +139,575 @@ class AdvisorPlayout : public SimplePlayout
      MoveAdvisor * advisor_;
 };
 
+/**
+ * Pool of playout workers (leaf parallelization).
+ *
+ * Descending thread hands over the leaf position and every worker 
+ * plays one playout from its own copy of it. Samples are summed 
+ * up so that the caller can back them up at once. Workers share the 
+ * context moves of the uct's advisor. Pool lives across searches.
+ */
+class PlayoutPool
+{
+  public:
+    /**
+     * Starts the worker threads.
+     *
+     * Workers are pinned to consecutive cores starting with 
+     * firstCore (-1 means no pinning).
+     */
+    PlayoutPool(int workersNum, int firstCore=-1);
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    ~PlayoutPool();
+
+    /**
+     * Hands the leaf position to the workers.
+     *
+     * Leaf is copied - caller might continue with its own playout.
+     * Uct decides the winners of the playouts.
+     */
+    void startPlayouts(const Uct* uct, const Board* leaf, uint playoutLen);
+
+    /**
+     * Waits until all workers are done.
+     *
+     * @return Sum of the samples of workers.
+     */
+    float waitPlayouts();
+
+    int getWorkersNum() const;
+
+  private:
+    PlayoutPool();
+
+    static void* workerWrapper(void* pool);
+
+    /**
+     * Worker waiting for the leaf and playing it out.
+     */
+    void workerLoop();
+
+    /**Uct deciding playout winner.*/
+    const Uct* uct_;
+    int workersNum_;
+    pthread_t threads_[MAX_THREADS];
+
+    pthread_mutex_t mutex_;
+    /**Signals new leaf or quit.*/
+    pthread_cond_t workCond_;
+    /**Signals all workers are done.*/
+    pthread_cond_t doneCond_;
+
+    /**Copy of the leaf position.*/
+    Board* leaf_;
+    uint playoutLen_;
+    /**Leaf counter - workers recognize new leaf.*/
+    int batch_;
+    /**Workers still playing.*/
+    int running_;
+    /**Index for the next starting worker.*/
+    int started_;
+    int firstCore_;
+    float sampleSum_;
+    bool quit_;
+};
+
+/**
+ * Task for the task pool.
+ */
+class Task
+{
+  public:
+    Task();
+    virtual ~Task();
+
+    /**
+     * Work of the task (runs in the pool worker).
+     */
+    virtual void run() = 0;
+
+    /**
+     * Whether task is finished (run or skipped because cancelled).
+     */
+    inline bool isDone() const { return done_; }
+
+    /**
+     * Task not started yet will not be run.
+     */
+    void cancel();
+    
+  private:
+    volatile bool done_;
+    volatile bool cancelled_;
+
+    friend class TaskPool;
+};
+
+/**
+ * Pool of helper threads with work stealing. 
+ *
+ * Every worker has its own queue - tasks are distributed to the queues 
+ * round robin. Worker takes the newest task from its queue and when 
+ * the queue is empty it steals the oldest task from other queues. 
+ * Pool lives across searches and is shared by search threads.
+ */
+class TaskPool
+{
+  public:
+    /**
+     * Starts the worker threads.
+     */
+    TaskPool(int workersNum);
+
+    /**
+     * Stops and joins the worker threads (tasks left are not run).
+     */
+    ~TaskPool();
+
+    /**
+     * Queues the task. 
+     *
+     * Task is owned by the caller and must not be deleted before it is done.
+     */
+    void submit(Task* task);
+
+    /**
+     * Blocks until the task is done.
+     */
+    void wait(Task* task);
+
+    int getWorkersNum() const;
+
+  private:
+    TaskPool();
+
+    struct Queue {
+      deque<Task*> tasks;
+      pthread_mutex_t mutex;
+    };
+
+    static void* workerWrapper(void* pool);
+
+    /**
+     * Worker running tasks until quit.
+     */
+    void workerLoop();
+
+    /**
+     * Newest task from the own queue or the oldest one stolen from others.
+     *
+     * @return Task or NULL if all queues are empty.
+     */
+    Task* take(int index);
+
+    /**
+     * Marks task done and wakes up its waiters.
+     */
+    void finish(Task* task);
+
+    int workersNum_;
+    pthread_t threads_[MAX_THREADS];
+    Queue queues_[MAX_THREADS];
+    /**Queue for the next task.*/
+    int next_;
+    /**Tasks in the queues.*/
+    volatile int pending_;
+    /**Index for the next starting worker.*/
+    int started_;
+    bool quit_;
+
+    pthread_mutex_t mutex_;
+    /**Signals new task or quit.*/
+    pthread_cond_t workCond_;
+    /**Signals finished task.*/
+    pthread_cond_t doneCond_;
+    /**Threads waiting for a task.*/
+    int waiters_;
+};
+
+/**
+ * Tactical analysis of the expanded node.
+ *
+ * Runs the tactics (fill_advisor) and heuristics of the children 
+ * for the copy of the position. Heuristics are attached to the node 
+ * by the searching thread.
+ */
+class TacticsTask : public Task
+{
+  public:
+    /**
+     * @param board Position of the node (copied).
+     * @param heuristics Whether children heuristics are computed.
+     */
+    TacticsTask(Uct* uct, Node* node, const Board* board, 
+                const StepArray& steps, uint stepsNum, bool heuristics);
+    ~TacticsTask();
+
+    void run();
+
+    /**
+     * Sets heuristics to the children of the node.
+     *
+     * Node's children must be those created from the steps.
+     */
+    void attach();
+
+  private:
+    TacticsTask();
+
+    Uct* uct_;
+    Node* node_;
+    Board* board_;
+    StepArray steps_;
+    uint stepsNum_;
+    HeurArray heurs_;
+    bool heuristics_;
+};
+
 /**
  * Tree wide step.
  *
- * Storing the step across the tree.
- * Also used for gathering statistics on the step 
+ * Gathering statistics on the step across the tree 
  * and utilizing these in history heuristic.
+ * Value and visits are packed in one word and updated atomically
+ * (statistics might be shared by search threads).
  * */
 class TWstep
 {
   public:
-    TWstep(Step, float, int);
-    Step step;
-    float value;
-    int visits;
+    TWstep();
+
+    /**
+     * Atomic update with playout sample.
+     *
+     * Sample might be a mean of count playouts.
+     */
+    void update(float sample, int count=1);
+
+    /**
+     * Resets to initial statistics.
+     */
+    void reset();
+
+    float getValue() const;
+    int getVisits() const;
+
+  private:
+    struct Stats {
+      float value;
+      int visits;
+    };
+
+    static u64 pack(const Stats& stats);
+    static Stats unpack(u64 packed);
+
+    /**Packed Stats.*/
+    volatile u64 packed_;
 } ; 
 
-typedef map<Step, TWstep> TWstepsMap;
+//step kinds (STEP_PASS ... STEP_NULL) x players x pieces x from x directions
+#define TWSTEPS_SIZE ((STEP_NULL + 1) * PLAYER_NUM * 8 * SQUARE_NUM * 4)
 
 /**
  * Structure to hold TWsteps.
  *
- * Derived from Map with custom []operator - if step is not 
- * in the map, adequate TWstep instance is created and saved.  
+ * Dense table indexed by packed (step kind, player, piece, from, direction).
+ * Push/pulls are distinguished by the moving piece only. 
  */
-class TWsteps: public TWstepsMap
+class TWsteps
 {
   public: 
+    TWsteps();
+
+    /**
+     * Statistics for the step.
+     */
     TWstep& operator[](const Step& step);
+
+    /**
+     * Resets all statistics.
+     */
+    void clear();
+
   private:
+    /**
+     * Packed index of the step.
+     */
+    static uint index(const Step& step);
+
+    TWstep table_[TWSTEPS_SIZE];
 };
 
 typedef set<Node*> NodeSet;
 
+/**
+ * Steps waiting for the materialization (progressive widening).
+ *
+ * Holds steps generated in the node expansion which have not 
+ * been turned into children yet. Steps are ordered by heuristic 
+ * value (best first). Shared by tt brothers the same way as children are.
+ */
+class PendingSteps
+{
+  public:
+    /**
+     * Constructor with steps to be held.
+     *
+     * Children are added by polynomial schedule - there might be 
+     * pw_init_children * (visits / baseVisits)^pw_exponent of them.
+     *
+     * @param steps Steps already ordered (best first).
+     * @param len Length of steps array.
+     * @param childrenNum Number of children already created.
+     * @param baseVisits Father's visits at the expansion.
+     */
+    PendingSteps(const Step* steps, const float* heurs, uint len, 
+                 uint childrenNum, float baseVisits);
+
+    ~PendingSteps();
+
+    /**
+     * Copy of the steps left.
+     */
+    PendingSteps* clone() const;
+
+    /**
+     * Checks whether there is any step left.
+     */
+    bool hasNext() const;
+
+    /**
+     * Takes next step (with its heuristic) and moves the threshold.
+     */
+    Step popNext(float & heur);
+
+    /**
+     * Visits threshold getter.
+     */
+    float getThreshold() const;
+
+  private:
+    PendingSteps();
+
+    /**
+     * Visits needed for one more child.
+     */
+    void updateThreshold();
+
+    /**Steps ordered by heuristic.*/
+    Step*   steps_;
+    /**Heuristics belonging to steps_.*/
+    float*  heurs_;
+    /**Length of steps_.*/
+    uint    len_;
+    /**Index of next step to materialize.*/
+    uint    next_;
+    /**Number of father's children (created ones).*/
+    uint    childrenNum_;
+    /**Father's visits at the expansion.*/
+    float   baseVisits_;
+    /**Number of father's visits needed for next materialization.*/
+    float   threshold_;
+};
+
+
+/**
+ * Cache of board snapshots.
+ *
+ * Bounded (direct mapped) cache: node ---> board in the node's position.
+ * Only boards at move boundaries are stored (position after commit). 
+ * Slot collision is resolved in favor of more visited node.
+ */
+class SnapshotCache
+{
+  public:
+    SnapshotCache(uint size);
+
+    ~SnapshotCache();
+
+    /**
+     * Loads snapshot for the node.
+     *
+     * @return Board in the node's position or NULL if not cached.
+     */
+    const Board* load(const Node* node) const;
+
+    /**
+     * Stores snapshot for the node (might be refused for collision).
+     */
+    void store(const Node* node, int visits, const Board* board);
+
+    /**
+     * Empties the cache (i.e. after nodes deletion).
+     */
+    void clear();
+
+  private:
+    SnapshotCache();
+
+    /**
+     * Slot for the node.
+     */
+    uint index(const Node* node) const;
+
+    /**Nodes the snapshots belong to.*/
+    const Node** nodes_;
+    /**Node's visits at the moment of storing.*/
+    int* visits_;
+    /**Snapshots.*/
+    Board* boards_;
+    /**Number of slots.*/
+    uint size_;
+};
 
 /**
- * One item of tt tables.
+ * One item of tt tables - position of the search dag.
  *
- * Contains shared statistics
- * and link to the node list.
+ * Position is stored once - its statistics and children are 
+ * shared by all nodes (edges) leading to it. Edges keep their own 
+ * visits. 
  */
 class TTitem 
 {
   public: 
-    TTitem(NodeList*); 
+    /**
+     * Constructor with the key under which item is stored in tt.
+     */
+    TTitem(u64 signature, uint playerIndex, int depthIdentifier); 
 
-    NodeList* getNodes() const;
+    u64 getSignature() const;
+    uint getPlayerIndex() const;
+    int getDepthIdentifier() const;
+
+    /**
+     * Number of nodes leading to the position.
+     */
+    int getRefs() const;
   private:
     TTitem(); 
 
-    /*Shared number of visits for tt brothers.*/
+    /*Number of visits of the position (through all edges).*/
     int visits_;
-    /*Shared average value for tt brothers.*/
+    /*Average value of the position.*/
     float value_;
-    /**TT brothers.*/
-    NodeList* nodes_;
+    /**Children of the position.*/
+    Node* firstChild_;
+    /**Pending steps of the position (progressive widening).*/
+    PendingSteps* pendingSteps_;
+    /**Changed with the children - children caches of edges are refreshed.*/
+    int childrenVersion_;
+    /**Number of nodes leading to the position.*/
+    int refs_;
+    /**Position signature (part of the tt key).*/
+    u64 signature_;
+    /**Player index (part of the tt key).*/
+    uint playerIndex_;
+    /**Depth identifier (part of the tt key).*/
+    int depthIdentifier_;
 
     friend class Node;
 };
 
+//number of entries in the shared transposition table
+#define SHARED_TT_SIZE (1 << 20)
+//entries in one bucket (bucket fits in a cache line)
+#define SHARED_TT_BUCKET 4
+//packed word of the entry: check bits of the key | visits | value (float)
+#define SHARED_TT_CHECK_BITS 12
+#define SHARED_TT_VISITS_BITS 20
+//visits are saturated
+#define SHARED_TT_MAX_VISITS ((1 << SHARED_TT_VISITS_BITS) - 1)
+
+/**
+ * Transposition table shared by search threads.
+ *
+ * Fixed size lock free table mapping 
+ * "key(position signature, player, depth identifier) ---> 
+ *    statistics of the position gathered by all threads".
+ * Statistics are packed in one word and updated by compare and swap 
+ * (like in TWstep). New position replaces the entry of old search or 
+ * the entry with the least visits in the bucket. Tag and packed word 
+ * are written separately - the packed word carries check bits of the 
+ * key so statistics of the replaced position are never taken for 
+ * the new one.
+ */
+class SharedTT
+{
+  public:
+    SharedTT(uint capacity = SHARED_TT_SIZE);
+    ~SharedTT();
+
+    /**
+     * Starts new search - entries of previous searches are invalidated.
+     */
+    void newSearch();
+
+    /**
+     * Key of the position (never 0).
+     */
+    u64 getKey(u64 signature, uint playerIndex, int depthIdentifier) const;
+
+    /**
+     * Loads statistics of the position.
+     *
+     * @return False if position is not in the table.
+     */
+    bool load(u64 key, float& value, int& visits) const;
+
+    /**
+     * Atomic update with playout sample. 
+     *
+     * Position is inserted if not in the table. Sample might be a mean 
+     * of count playouts.
+     *
+     * @return Value of the position after the update.
+     */
+    float update(u64 key, float sample, int count=1);
+
+  private:
+    SharedTT(const SharedTT&);
+    SharedTT& operator=(const SharedTT&);
+
+    struct Stats {
+      float value;
+      int visits;
+    };
+
+    struct Entry {
+      /**Key with the generation in the lowest byte.*/
+      volatile u64 tag;
+      /**Packed Stats.*/
+      volatile u64 packed;
+    };
+
+    static u64 pack(const Stats& stats, u64 tag);
+
+    /**
+     * @return False if the packed word belongs to other key than tag's.
+     */
+    static bool unpack(u64 packed, u64 tag, Stats& stats);
+
+    static int packedVisits(u64 packed);
+
+    /**
+     * Entry with given tag in the bucket.
+     *
+     * @return Entry or NULL.
+     */
+    Entry* find(Entry* bucket, u64 tag) const;
+
+    Entry* table_;
+    /**Number of buckets - 1 (power of 2).*/
+    uint mask_;
+    /**Actual generation (lowest byte of tags, never 0).*/
+    uint generation_;
+    u64 playerSignature_[2];
+    u64 levelSignature_[MAX_LEVELS];
+};
+
 /**
  * Node in the Uct tree. 
  */
@@ -196,9 +719,9 @@ class Node
     ~Node();
 
     /**
-     * Constructor with step and heuristic 
+     * Constructor with step, its statistics and heuristic 
      */
-    Node(TWstep*,  float heur=0);
+    Node(const Step&, TWstep*,  float heur=0);
 
     /**
      * Finds child with highest UCB1 value.
@@ -235,6 +758,11 @@ class Node
      */
     void cCacheUpdate(float exploreCoeff);
 
+    /**
+     * Forces children cache refresh (i.e. after children addition).
+     */
+    void cCacheInvalidate();
+
     /**
      * DRY-purpose method.
      */
@@ -242,19 +770,39 @@ class Node
 
     /**
      * The UCB1 formula.
+     *
+     * Value and visits are given explicitly (might include virtual loss).
      */
-    float ucb(float exploreCoeff) const;
+    float ucb(float exploreCoeff, float value, int visits) const;
 
     /**
      * The UCB-tuned formula.
      */
-    float ucbTuned(float exploreCoeff) const;
+    float ucbTuned(float exploreCoeff, float value, int visits) const;
 
     /**
      * Children addition during node expansion.
      */
     void  addChild(Node* child);
 
+    /**
+     * Atomic publication of children (shared tree).
+     *
+     * Children list (linked by siblings, fathers already set) is 
+     * set only if node has no children yet.
+     * @return False if other thread was faster (list stays to the caller).
+     */
+    bool  publishChildren(Node* head);
+
+    /**
+     * Virtual loss - thread descending through the node (shared tree).
+     *
+     * Until removed, virtual loss counts as a lost simulation so that 
+     * other threads are led to other parts of the tree.
+     */
+    void  addVirtualLoss();
+    void  removeVirtualLoss();
+
     /**
      * Reverse order of children.
      */
@@ -262,9 +810,19 @@ class Node
 
     /**
      * Deletes children recursively. 
+     *
+     * Shared children (tt) are deleted by the last node leading to the position.
      */
     void  delChildrenRec();
 
+    /**
+     * Forgets children (they were deleted in the tree pruning).
+     *
+     * Node becomes a leaf again - pending steps and 
+     * children cache are dropped as well.
+     */
+    void  clearChildren();
+
     /**
      * Connect the node to its master (in parallel search).
      *
@@ -273,16 +831,19 @@ class Node
      *
      * @param lock Use lock on the father tree. Lockless connection 
      * might be used from within the connectChildrenToMaster.
+     * @return Number of nodes created in the master tree (0 or 1).
      */
-    void connectToMaster(const bool lock=true);
+    int connectToMaster(const bool lock=true);
 
     /**
      * Atomic children connecting to their masters (in parallel search).
      *
      * 
      * from the father). Sets the master_ pointer to the master node.
+     *
+     * @return Number of nodes created in the master tree.
      */
-    void connectChildrenToMaster();
+    int connectChildrenToMaster();
 
     /**
      * One node commit. 
@@ -299,25 +860,35 @@ class Node
     void recSyncMaster();
 
     /**
-     * Value update of tt connected nodes. 
+     * Value update of the node's position (tt item). 
      *
-     * Performed after node update.
+     * Performed after node update. Item of a shared tree node (concurrent) 
+     * is updated atomically.
      */
-    void  updateTTbrothers(float sample=0, int size=0);
+    void  updateTTitem(float sample=0, int size=0, bool concurrent=false);
 
     /**
      * Update after playout. 
      *
-     * Updates value/visits.
+     * Updates value/visits. Node of a shared tree (concurrent) is updated atomically.
+     * Sample might be a mean of count playouts (leaf parallelization).
      */
-    void  update(float);
+    void  update(float sample, int count=1, bool concurrent=false);
     
     /**
      * Update after playout. 
      *
      * Updates value/visits of twStep.
      */
-    void  updateTWstep(float);
+    void  updateTWstep(float sample, int count=1);
+
+    /**
+     * Progressive widening test.
+     *
+     * Checks whether node has pending steps and whether it 
+     * was visited enough to materialize next one.
+     */
+    bool  canWiden() const;
 
     /**
      * Maturity test.
@@ -341,6 +912,10 @@ class Node
     void  setSibling(Node*);
     TTitem* getTTitem() const;
     void setTTitem(TTitem * node);
+    u64 getSharedKey() const;
+    void setSharedKey(u64 key);
+    PendingSteps* getPendingSteps() const;
+    void setPendingSteps(PendingSteps* pendingSteps);
     Step  getStep() const;
     TWstep*  getTWstep() const;
     player_t getPlayer() const;
@@ -348,6 +923,27 @@ class Node
     void  setVisits(int visits); 
     float getValue() const;
     void setValue(float value);
+    float getHeur() const;
+    void setHeur(float heur);
+
+    /**
+     * Proven result of the node's position (mcts solver).
+     *
+     * @return Winner or NO_PLAYER if the position is not proven.
+     */
+    player_t getProven() const;
+    void setProven(player_t winner);
+    bool isProven() const;
+
+    /**
+     * Takes value, visits and variance of other node.
+     */
+    void copyStatistics(const Node* node);
+
+    /**
+     * Takes value and visits of the other node's tt item (both nodes must have items).
+     */
+    void copyTTitemStatistics(const Node* node);
     void setMaster(Node* master);
     Node* getMaster();
     void lock();
@@ -393,7 +989,11 @@ class Node
     float       squareSum_;
     /**Number of simulations throught the node.*/
     int         visits_;
-    /**Pointer to corresponding twStep (carrying the actual step to make).*/
+    /**Number of threads actually descending through the node (shared tree).*/
+    int         virtualLoss_;
+    /**Step to make.*/
+    Step        step_;
+    /**Pointer to corresponding twStep (step statistics).*/
     TWstep*     twStep_;
 
     /**Master value from last sync.*/
@@ -404,12 +1004,20 @@ class Node
 
     /**Transposition tables item.*/
     TTitem*       ttItem_;
+    /**Key in the shared transposition table (0 if not there).*/
+    u64           sharedKey_;
+    /**Steps not materialized yet (progressive widening).*/
+    PendingSteps* pendingSteps_;
+    /**Proven winner (NO_PLAYER if not proven).*/
+    volatile player_t proven_;
 
     Node*       sibling_;
     Node*       firstChild_;  
     Node*       father_;
     /**Holds the number of visit when the ccache was last updated.*/
     int         cCacheLastUpdate_;
+    /**Children version of the tt item the ccache was updated for.*/
+    int         cCacheVersion_;
     /**Node's ccache. Actual allocation is performed when ccache is first used.*/
     Node**      cCache_; 
     /**Mirror of the node in the master tree.*/
@@ -419,6 +1027,26 @@ class Node
     pthread_mutex_t mutex;
 };
 
+/**
+ * Node statistics with the path from the root. 
+ *
+ * Used for exchanging statistics of the first move among 
+ * processes (root parallelization). 
+ */
+struct NodeStat
+{
+  /**Steps from the root (at most one move).*/
+  Step steps[STEPS_IN_MOVE];
+  int stepsNum;
+  int visits;
+  float value;
+};
+
+typedef vector<NodeStat> NodeStats;
+
+//cleared transposition tables kept for the next trees
+#define TT_POOL_SIZE 64
+
 /**
  * Uct tree. 
  */
@@ -437,8 +1065,31 @@ class Tree
      * Constructor which creates root node. 
      * 
      * Root node is created(bottom of history stack) with given player.
+     * @param twSteps History heuristic table shared with other trees 
+     *                (NULL means tree uses its own one).
+     * @param sharedTT Transposition table shared with other trees 
+     *                 (NULL means none).
+     */
+    Tree(player_t firstPlayer, TWsteps* twSteps=NULL, SharedTT* sharedTT=NULL);   
+
+    /**
+     * Constructor of the shared tree view. 
+     *
+     * View has its own history (one per thread) but descends 
+     * the nodes of sharedTree. Nodes are not owned by the view.
+     */
+    Tree(Tree* sharedTree);   
+
+    /**
+     * Constructor reusing the subtree of the old tree.
+     *
+     * Subtree of node is copied into fresh nodes and node becomes 
+     * the root. Transpositions are linked in the tt of the new tree.
+     *
+     * @param board Board in the position of node - repetitions 
+     *              in the first move are filtered again.
      */
-    Tree(player_t firstPlayer);   
+    Tree(const Tree* tree, const Node* node, const Board* board);   
 
     /**
      * Destructor.
@@ -452,10 +1103,56 @@ class Tree
      */
     void syncMaster();
 
+    /**
+     * Cuts the links to the released nodes of the master tree.
+     *
+     * Only the linked part of the tree is walked (links below 
+     * a released master are released as well). View of a shared 
+     * tree drops its snapshots instead.
+     */
+    void detachMaster(const set<const Node*>& released);
+
+    /**
+     * Whether tree is a view of shared tree. 
+     */
+    bool isShared() const;
+
+    /**
+     * Deletes the tables kept for the next trees (e.g. when the engine goes down).
+     */
+    static void freeTTpool();
+
+    /**
+     * Finds the node of the position.
+     *
+     * Searches at most maxMoves moves deep (through nodes with 
+     * at least minVisits). Position might be reached by more step orders, 
+     * the most visited node is taken.
+     *
+     * @param rootBoard Board in the position of the root.
+     * @return Node after which the board's position is to move or NULL.
+     */
+    const Node* findPosition(const Board* rootBoard, const Board* board, 
+                             int maxMoves, int minVisits) const;
+
+    /**
+     * Whether transposition tables are used.
+     *
+     * Not possible in shared tree.
+     */
+    bool useTT() const;
+
+    /**
+     * Whether shared transposition table is used.
+     */
+    bool useSharedTT() const;
+
     /**
      * Node expansion.
      *
-     * Creates children for every given step. 
+     * Creates children for every given step. With progressive widening
+     * only the best steps (by heuristics) are materialized, the rest 
+     * is stored as pending steps (see widenNode).
      * @param steps - Given steps (already filtered through repetition tests, 
      *                virtual pass test, transposition tables).
      * @param len - Length of steps array.
@@ -463,6 +1160,14 @@ class Tree
      */
     void  expandNode(Node* node, const StepArray& steps, uint len, const HeurArray* heurs=NULL);
 
+    /**
+     * Progressive widening.
+     *
+     * Materializes next pending step of the node as a new child.
+     * @param board Board in the position of the node (for tt update).
+     */
+    void  widenNode(Node* node, const Board* board);
+
     /*
      * Limited Node expansion.
      *
@@ -502,6 +1207,21 @@ class Tree
      */
     Node* findBestMoveNode(Node* subTreeRoot);
 
+    /**
+     * Visits of the most visited rival of the best move.
+     *
+     * Rivals are the other move nodes in the topmost level of the tree.
+     */
+    int findRivalVisits(const Node* bestMoveNode);
+
+    /**
+     * Whether a rival with comparable visits has better value.
+     *
+     * Rivals with at least UNSTABLE_VISITS_RATIO of the best move's 
+     * visits are considered. Proven best move is stable.
+     */
+    bool isBestMoveUnstable(const Node* bestMoveNode);
+
     /** 
      * Move for given Node.
      *
@@ -510,10 +1230,55 @@ class Tree
      */
     Move findBestMove(Node* bestMoveNode);
 
+    /**
+     * Most visited move after the father.
+     *
+     * Subtree of the father is walked in place (proven losses are avoided).
+     * Steps are collected on the way down - fathers are not reliable 
+     * in the transposed tree.
+     *
+     * @return False if there is no move under the father.
+     */
+    bool findMostVisitedMove(const Node* father, Move& move) const;
+
     /**
      * Backpropagation of playout sample.
+     *
+     * Sample might be a mean of count playouts (leaf parallelization).
+     */
+    void updateHistory(float sample, int count=1);
+
+    /**
+     * Proves the actual node and propagates the proof up the history.
+     *
+     * Node is won for the player to move if any child is his win 
+     * and lost if all children (no steps pending) are his loss.
+     * Must be called before the history is updated (and reset).
      */
-    void updateHistory(float);
+    void proveHistory(player_t winner);
+
+    /**
+     * Collects statistics of the first move layer.
+     *
+     * Root and nodes of the root player's move visited at least 
+     * minVisits times are stored (fathers before children).
+     */
+    void collectFirstMoveStats(NodeStats& stats, int minVisits);
+
+    /**
+     * Adds statistics gathered by other search (process). 
+     *
+     * Nodes are found by the paths, missing ones are created. 
+     * Fathers must come before their children.
+     * @param board Board in the position of the root - paths with steps 
+     *              not allowed here (repetitions) are dropped. NULL = no check.
+     */
+    void mergeFirstMoveStats(const NodeStats& stats, const Board* board=NULL);
+
+    /**
+     * Whether steps (from the board's position) pass the repetition filter.
+     */
+    bool isPathAllowed(const Board* board, const Step* steps, int stepsNum) const;
 
     /**
      * History reset.
@@ -547,6 +1312,36 @@ class Tree
      */
     int getNodesExpandedNum();
 
+    /**
+     * Nodes released (by pruning) getter.
+     */
+    int getNodesReleasedNum();
+
+    /**
+     * Keeps the tree within nodes limit. 
+     *
+     * Repeatedly cuts the least visited frontier nodes (nodes with 
+     * leaf children only) back to leaves until the tree has 
+     * at most targetNodesNum nodes. Root is never cut. 
+     * Must be called outside of descend (history is reset).
+     *
+     * @param released Released nodes are collected here (NULL - not collected).
+     */
+    void pruneLeastVisited(int targetNodesNum, set<const Node*>* released=NULL);
+
+    /**
+     * Restores board for the actual node. 
+     *
+     * Descend is replayed from the deepest cached snapshot in the history 
+     * (or from the root board). Replay stops prematurely when the game ends -
+     * history is then cut to the node where the winner was decided.
+     * Boards at visited move boundaries are stored to the snapshots cache.
+     *
+     * @param rootBoard Board in the root position.
+     * @return New board (to be deleted by caller).
+     */
+    Board* restoreBoard(const Board* rootBoard);
+
     /**
      * String representation of the tree.
      */
@@ -565,12 +1360,30 @@ class Tree
      *
      * Every children of given father is checked:
      *    if it's position is unique in TT it's added 
-     *    if it's position already exists in TT, it's children are linked
+     *    if it's position already exists in TT, node is linked to it 
+     *    (statistics and children of the position are shared)
      *
      * @param father it's children will get updated
      */
     void updateTT(Node* father, const Board* board);
 
+    /**
+     * Updates Transposition tables for one node. 
+     *
+     * @param board Board in the position of node's father.
+     */
+    void updateTTnode(Node* node, const Board* board);
+
+    /**
+     * Assigns shared tt keys to the children of father.
+     *
+     * Children of positions known from the shared tt (found by 
+     * any thread) are warm started with their value.
+     *
+     * @param board Board in the position of father.
+     */
+    void updateSharedTT(Node* father, const Board* board);
+
 
   private:
     friend class Uct;
@@ -584,7 +1397,19 @@ class Tree
     /**
      * Constructor wide init.
      */
-    void init();
+    void init(TWsteps* twSteps=NULL, bool shared=false, SharedTT* sharedTT=NULL);
+
+    /**
+     * Transposition table for a new tree.
+     *
+     * Table of some deleted tree is reused if possible (it keeps its capacity).
+     */
+    static TT* acquireTT();
+
+    /**
+     * Table of deleted tree is cleared and kept for the next trees.
+     */
+    static void releaseTT(TT* tt);
 
     /**
      * Level calculation.
@@ -596,6 +1421,77 @@ class Tree
      */
     static int calcNodeLevel(Node* father, const Step& step);
 
+    /**
+     * Pushes node to the history (virtual loss in shared tree).
+     */
+    void historyPush(Node* node);
+
+    /**
+     * Gathers frontier nodes in the subtree (for pruning).
+     *
+     * Positions (tt items) are visited once (children are shared).
+     */
+    void collectFrontier(Node* node, vector<Node*>& frontier, set<const TTitem*>& positions);
+
+    /**
+     * Deletes (leaf) children of the node. 
+     *
+     * Children statistics are committed to the master before deletion, 
+     * tt entries are released and node together with its tt brothers 
+     * becomes a leaf.
+     */
+    void releaseChildren(Node* node, set<const Node*>* released);
+
+    /**
+     * Deletes node and releases its tt entry.
+     */
+    void releaseNode(Node* node, set<const Node*>* released);
+
+    /**
+     * Recursive part of detachMaster.
+     */
+    void detachMasterRec(Node* node, const set<const Node*>& released, set<const Node*>& visited);
+
+    /**
+     * Counts new nodes of the tree. 
+     *
+     * Nodes of the shared tree view are counted in the shared tree as well.
+     */
+    void addNodes(int num);
+
+    /**
+     * Counts nodes created in the master tree (by the links of this tree).
+     */
+    void addMasterNodes(int num);
+
+    /**
+     * Recursive search for the position from node.
+     *
+     * @param nodeBoard Board in the position of node.
+     */
+    const Node* findPositionRec(const Node* node, const Board* nodeBoard, const Board* board, 
+                                int movesLeft, int minVisits) const;
+
+    /**
+     * Recursive part of findMostVisitedMove.
+     *
+     * @param steps Steps from the father to node.
+     * @param best  Most visited move node found so far.
+     */
+    void findMostVisitedMoveRec(const Node* node, player_t player, Step* steps, int depth, 
+                                const Node*& best, Move& move) const;
+
+    /**
+     * Copies children of node (recursively) under copy.
+     *
+     * Children are linked to the tt of the tree - children of transposed 
+     * positions are copied once (under the first node reaching them).
+     *
+     * @param board Board in the position of node (NULL if not needed - no tt, after first move).
+     * @param firstMove Whether node is in the first move (repetitions are filtered).
+     */
+    void copyChildren(Node* copy, const Node* node, const Board* board, bool firstMove);
+
     /**Simulation history
      *
      * Hardcoded length for speedup - in playout check for overflow.*/
@@ -608,13 +1504,31 @@ class Tree
     int   nodesNum_;
     /**Number of pruned nodes in tt.*/
     int nodesPrunedNum_;
-    /**Map of tree wide steps. 
+    /**Number of nodes released due to the nodes limit.*/
+    int nodesReleasedNum_;
+    /**Table of tree wide steps. 
      *
      * Every step with its value (average of all values in the tree) 
-     * is stored here. This is used to init new node.*/
-    TWsteps  twSteps_;
+     * is stored here. This is used to init new node.
+     * Might be shared with other trees in parallel search.*/
+    TWsteps*  twSteps_;
+    /**Whether twSteps_ belongs to this tree.*/
+    bool      ownTWsteps_;
+    /**Tree is a view of shared tree (nodes are not owned).*/
+    bool      shared_;
+    /**Master tree or the shared tree of the view (NULL if none) - nodes are counted there.*/
+    Tree*     masterTree_;
     /**Transposition table.*/
     TT* tt_;              
+    /**Cleared tables of deleted trees.*/
+    static TT* ttPool_[TT_POOL_SIZE];
+    static int ttPoolNum_;
+    /**Guards ttPool_ - trees are created and deleted by more threads.*/
+    static pthread_mutex_t ttPoolLock_;
+    /**Transposition table shared by search threads (not owned, NULL if not used).*/
+    SharedTT* sharedTT_;
+    /**Board snapshots (NULL if switched off).*/
+    SnapshotCache* snapshots_;
     
 };
 
@@ -634,9 +1548,17 @@ class Uct
      * Constructor for parallel search.
      *
      * Uses masterUct pointer to assign master brother to the 
-     * root node in the actual tree.
+     * root node in the actual tree. SharedTT is shared by all
+     * search threads (NULL means none).
+     */
+    Uct(const Board* board, Uct* masterUct, SharedTT* sharedTT=NULL);
+
+    /**
+     * Constructor reusing the subtree of node from the tree of uct.
+     *
+     * @param board Board in the position of node.
      */
-    Uct(const Board* board, const Uct* masterUct);
+    Uct(const Board* board, const Uct* uct, const Node* node);
 
     ~Uct();
 
@@ -648,12 +1570,27 @@ class Uct
      */
     void updateStatistics(Uct* ucts[], int uctsNum);
 
+    /**
+     * Merges statistics of remote search (root parallelization).
+     */
+    void mergeRemoteStatistics(const NodeStats& stats, int playouts, const Board* board);
+
+    /**
+     * Playouts and new nodes after which searchTree stops (-1 = no limit).
+     */
+    void setSearchLimits(int playouts, int nodes);
+
     /**
      * Crucial method implementing search.
      *
-     * Runs the doPlayout loop.
+     * Runs the doPlayout loop. If playout pool is given, playouts 
+     * from the leaf are run in parallel by its workers. If tactics pool
+     * is given, tactics of the expanded nodes are run asynchronously 
+     * by its workers. Engine is given the uct every BEST_MOVE_CHECK_INTERVAL 
+     * playouts to check the best move (time management).
      */
-     void searchTree(const Board*, const Engine*);
+     void searchTree(const Board*, const Engine*, PlayoutPool* playoutPool=NULL, 
+                     TaskPool* tacticsPool=NULL);
 
     /**
      * Results refinement after search.
@@ -719,7 +1656,7 @@ class Uct
     /**
      * Constructor wide initialization.
      */
-    void init(const Board* board);
+    void init(const Board* board, Tree* tree, ContextMoves* contextMoves=NULL);
 
     /**
      * Decide winner of the game. 
@@ -729,11 +1666,42 @@ class Uct
      */
     double decidePlayoutWinner(const Board*) const;
 
+    /**
+     * Lazy board materialization in the descend.
+     *
+     * If playBoard is not created yet, it is restored for the actual node.
+     * @return False if the game ended on the way (history is updated then).
+     */
+    bool restorePlayBoard(const Board* board, Board* & playBoard);
+
     /**
      * Fills advisor with moves from tactical search. 
      */
     void fill_advisor(const Board * playBoard);
 
+    /**
+     * Whether tactics of the expanded nodes are run asynchronously.
+     *
+     * Children must not be reordered (progressive widening) or 
+     * released (nodes limit) before the tactics are attached.
+     */
+    bool useAsyncTactics() const;
+
+    /**
+     * Attaches the finished tactics tasks.
+     *
+     * @param all Waits for (or cancels) all the tasks.
+     */
+    void attachTactics(bool all=false);
+
+    /**
+     * Prunes the tree of the master uct.
+     *
+     * Called by a search thread, threads' playouts are paused meanwhile 
+     * and links of their trees to the released nodes are cut.
+     */
+    void pruneMaster(int targetNodesNum);
+
     /**UCT tree*/
     Tree* tree_;
     /**Evaluation object*/
@@ -744,10 +1712,31 @@ class Uct
     string bestMoveRepr_;  
     /**Total number of playouts.*/
     int playouts_;
+    /**Search stops after this number of playouts (-1 = no limit).*/
+    int playoutsLimit_;
+    /**Search stops after this number of new nodes (-1 = no limit).*/
+    int nodesLimit_;
     /**Total number of uct descends through the tree.*/
     int uctDescends_;
-    /*Move advisor is filled during the expansion process and is used in th playouts.*/
+    /*Move advisor is filled during the expansion process and is used in th playouts.
+     *
+     * Its context moves might be shared with other threads.*/
     MoveAdvisor * advisor_;
+    /**Playout workers for leaf parallelization (NULL when not used).*/
+    PlayoutPool * playoutPool_;
+    /**Helper threads for the tactics (NULL when not used).*/
+    TaskPool * tacticsPool_;
+    /**Tactics tasks not attached yet.*/
+    list<TacticsTask*> tacticsTasks_;
+    /**Uct of the master (shared) tree in parallel search (NULL if none).*/
+    Uct* masterUct_;
+    /**Ucts of the search threads linked to this (master) uct.*/
+    vector<Uct*> workers_;
+    /**Playouts hold it for reading, master tree pruning for writing.*/
+    pthread_rwlock_t pruneLock_;
+
+    friend class PlayoutPool;
+    friend class TacticsTask;
 };
 
 
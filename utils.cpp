@@ -1,3 +1,7 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
 #include "utils.h"
 
 #define INITIAL_SEED 0x38F271A
@@ -273,3 +277,17 @@ string replaceAllChars(string s, char c1, char c2)
 }
 
 //--------------------------------------------------------------------- 
+
+bool pinThreadToCore(int core)
+{
+  long coresNum = sysconf(_SC_NPROCESSORS_ONLN);
+  if (coresNum < 1){
+    return false;
+  }
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(core % coresNum, &cpuset);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+}
+
+//---------------------------------------------------------------------
@@ -47,7 +47,7 @@ enum logLevel_e { LL_DEBUG, LL_WARNING, LL_ERROR, LL_INFO, LL_RAW, LL_DDEBUG };
 
 #define STR_LOAD_FAIL "Fatal error occured while loading position."
 
-#define MAX_THREADS 17
+#define MAX_THREADS 256
 
 #define GRAND_MAX 0xFFFFFFFF
 
@@ -215,3 +215,11 @@ string getStreamRest(istream& is);
  * Replaces all ocurences of c1 in s by c2.
  */
 string replaceAllChars(string s, char c1, char c2);
+
+/**
+ * Pins the calling thread to the core. 
+ *
+ * Cores are taken modulo number of online cores.
+ * @return False if pinning failed.
+ */
+bool pinThreadToCore(int core);